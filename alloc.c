@@ -0,0 +1,177 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <gc.h>
+
+#include "alloc.h"
+#include "error.h"
+
+/* By default the collector treats a pointer to anywhere inside an
+   object as keeping it alive, and pays for that by padding every
+   object with an extra byte, which moves two-word pairs into the
+   four-word size class.  We turn that off and register only the
+   displacements that the interpreter keeps pointers at: pointer tags,
+   and fields within the first words of an object (such as those
+   returned by the term_as_* accessors, or a table inside a hash).
+   Pointers further in, such as those a loop over an array steps
+   through, are covered by alloc_keep_alive (see alloc.h). */
+void alloc_init(void)
+{
+        GC_set_all_interior_pointers(0);
+        GC_INIT();
+        for (size_t i = 1; i <= ALLOC_TAG_MASK; i++) {
+                GC_register_displacement(i);
+        }
+        for (size_t i = 8; i <= 32; i += 8) {
+                GC_register_displacement(i);
+        }
+}
+
+static void *new_object(size_t size)
+{
+        void *rv = GC_malloc(size);
+        if (rv == NULL) enomem();
+        return rv;
+}
+
+static void (*sample_hook)(enum alloc_kind, void *, size_t) = NULL;
+static unsigned long sample_every, sample_countdown;
+
+static void sample(enum alloc_kind kind, void *obj, size_t size)
+{
+        if (--sample_countdown > 0) return;
+        sample_countdown = sample_every;
+        // allocations made by the hook itself are not sampled
+        void (*hook)(enum alloc_kind, void *, size_t) = sample_hook;
+        sample_hook = NULL;
+        hook(kind, obj, size);
+        sample_hook = hook;
+}
+
+void alloc_on_sample(void (*hook)(enum alloc_kind kind, void *obj,
+                                  size_t size),
+                     unsigned long every)
+{
+        sample_every = every > 0 ? every : 1;
+        sample_countdown = sample_every;
+        sample_hook = hook;
+}
+
+const char *alloc_kind_name(enum alloc_kind kind)
+{
+        static const char *const names[ALLOC_KINDS] = {
+                [ALLOC_OTHER] = "other",
+                [ALLOC_PAIR] = "pair",
+                [ALLOC_NUMBER] = "number",
+                [ALLOC_SYMBOL] = "symbol",
+                [ALLOC_TERM] = "term",
+                [ALLOC_ENV] = "env",
+                [ALLOC_CLOSURE] = "closure",
+                [ALLOC_ARGS] = "args",
+        };
+        return names[kind];
+}
+
+void *alloc_object_of(enum alloc_kind kind, size_t size)
+{
+        void *rv = new_object(size);
+        if (sample_hook != NULL) sample(kind, rv, size);
+        return rv;
+}
+
+void *alloc_object(size_t size)
+{
+        return alloc_object_of(ALLOC_OTHER, size);
+}
+
+void *alloc_atomic_of(enum alloc_kind kind, size_t size)
+{
+        void *rv = GC_malloc_atomic(size);
+        if (rv == NULL) enomem();
+        if (sample_hook != NULL) sample(kind, rv, size);
+        return rv;
+}
+
+void *alloc_atomic(size_t size)
+{
+        return alloc_atomic_of(ALLOC_OTHER, size);
+}
+
+void alloc_keep_alive(const void *p)
+{
+        GC_reachable_here(p);
+}
+
+void *alloc_realloc(void *p, size_t size)
+{
+        void *rv = GC_realloc(p, size);
+        if (rv == NULL) enomem();
+        if (sample_hook != NULL) sample(ALLOC_OTHER, rv, size);
+        return rv;
+}
+
+static void (*collection_hook)(_Bool start);
+
+static void collection_event(GC_EventType event)
+{
+        if (event == GC_EVENT_START) {
+                collection_hook(1);
+        } else if (event == GC_EVENT_END) {
+                collection_hook(0);
+        }
+}
+
+void alloc_on_collection(void (*hook)(_Bool start))
+{
+        collection_hook = hook;
+        GC_set_on_collection_event(collection_event);
+}
+
+void alloc_weak_ref(uintptr_t *ref, void *obj)
+{
+        *ref = GC_HIDE_POINTER(obj);
+        if (GC_general_register_disappearing_link((void **)ref, obj)
+            == GC_NO_MEMORY) {
+                enomem();
+        }
+}
+
+_Bool alloc_weak_ref_is(uintptr_t ref, void *obj)
+{
+        return ref != 0 && ref == (uintptr_t)GC_HIDE_POINTER(obj);
+}
+
+unsigned long alloc_collections(void)
+{
+        return GC_get_gc_no();
+}
+
+size_t alloc_heap_size(void)
+{
+        return GC_get_heap_size();
+}
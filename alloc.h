@@ -0,0 +1,111 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+ 
+#ifndef GUARD_ALLOC_H
+#define GUARD_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* All interpreter objects (data, terms, environments, vectors) are
+   allocated through this interface rather than by calling the
+   collector directly, so that allocations can be counted and sampled
+   by kind in one place.  The collector behind it is Boehm GC, a
+   conservative, non-moving mark-sweep collector.
+ */
+
+/* Objects are aligned to at least eight bytes, so the low three bits
+   of a pointer to an object are free for use as a type tag.  A tagged
+   pointer keeps its object alive just like an untagged one. */
+#define ALLOC_TAG_MASK 7
+
+/* Initializes the collector.  Must be called from main before any
+   allocation. */
+void alloc_init(void);
+
+/* What an object is allocated for, as told by the _of variants of
+   the allocation functions below.  Only the heap profile (see
+   alloc_on_sample) makes use of this. */
+enum alloc_kind {
+        ALLOC_OTHER,
+        ALLOC_PAIR,
+        ALLOC_NUMBER,
+        ALLOC_SYMBOL,
+        ALLOC_TERM,
+        ALLOC_ENV,      // environments and their nodes
+        ALLOC_CLOSURE,
+        ALLOC_ARGS,     // vectors of arguments and of variable values
+        ALLOC_KINDS
+};
+
+/* Returns a name for kind, such as "pair". */
+const char *alloc_kind_name(enum alloc_kind kind);
+
+/* Allocates a zeroed object that may contain pointers. */
+void *alloc_object(size_t size);
+void *alloc_object_of(enum alloc_kind kind, size_t size);
+
+/* Allocates an object that will never contain pointers into the
+   heap.  The contents are not initialized. */
+void *alloc_atomic(size_t size);
+void *alloc_atomic_of(enum alloc_kind kind, size_t size);
+
+/* Resizes an object allocated with alloc_object. */
+void *alloc_realloc(void *p, size_t size);
+
+/* Only a pointer to the start of an object, or to one of its first
+   few words, keeps it alive.  A loop that steps through an array while
+   it allocates may be compiled to keep nothing but a pointer further
+   in, so it must call this on the start of the array after the loop,
+   which keeps the array alive until then. */
+void alloc_keep_alive(const void *p);
+
+/* Makes the collector call hook(1) when it starts a collection and
+   hook(0) when it has finished one. */
+void alloc_on_collection(void (*hook)(_Bool start));
+
+/* Makes the allocator call hook on one allocation in every sample
+   (counting all the allocation functions above), with the kind, the
+   object and the size requested. */
+void alloc_on_sample(void (*hook)(enum alloc_kind kind, void *obj,
+                                  size_t size),
+                     unsigned long sample);
+
+/* Stores in *ref a weak reference to obj, which does not keep obj
+   alive.  The collection that finds obj unreachable sets *ref to 0. */
+void alloc_weak_ref(uintptr_t *ref, void *obj);
+
+/* Returns whether the weak reference ref refers to obj. */
+_Bool alloc_weak_ref_is(uintptr_t ref, void *obj);
+
+/* Returns the number of collections done so far, and the size of the
+   heap in bytes. */
+unsigned long alloc_collections(void);
+size_t alloc_heap_size(void);
+
+#endif /* GUARD_ALLOC_H */
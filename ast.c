@@ -27,10 +27,14 @@
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
 #include <assert.h>
-#include <gc.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "alloc.h"
 
 #include "ast.h"
 #include "error.h"
+#include "primops.h"
 #include "strvec.h"
 
 struct term {
@@ -44,18 +48,37 @@ struct term {
                 struct mu_term mu;
                 struct guarded_term *guarded;
                 struct define_term *define;
+                struct catch_term catch;
+                struct loop_term loop;
+                struct delay_term delay;
         } u;
 };
 
 static struct term *new_term(enum term_type tt, struct datum *d)
 {
-        struct term *rv = GC_malloc(sizeof *rv);
-        if (rv == NULL) enomem();
+        struct term *rv = alloc_object_of(ALLOC_TERM, sizeof *rv);
         rv->type = tt;
         rv->orig = d;
         return rv;
 }
 
+// could evaluating d create a closure or bind variables in the
+// current environment?  (This errs on the side of yes: quoted lambdas
+// count, for example.)
+static bool may_capture_env(struct datum *d)
+{
+        if (get_type(d) != T_PAIR) return false;
+        struct datum *head = get_pair_first(d);
+        if (is_this_symbol(head, "LAMBDA") || is_this_symbol(head, "LABEL") ||
+            is_this_symbol(head, "DEFINE") || is_this_symbol(head, "DELAY")) {
+                return true;
+        }
+        for (; get_type(d) == T_PAIR; d = get_pair_second(d)) {
+                if (may_capture_env(get_pair_first(d))) return true;
+        }
+        return false;
+}
+
 static struct term *parse_list(struct datum *d)
 {
         struct datum *head = get_pair_first(d);
@@ -81,6 +104,69 @@ static struct term *parse_list(struct datum *d)
                         rv->u.mu.body = restd.vec[1]; 
                         return rv;
                 }
+                if (is_this_symbol(head, "CATCH")) {
+                        struct list_data restd = get_list_data(rest);
+                        if (restd.n != 1 || !is_NIL(restd.terminator)) {
+                                return new_term(TT_OTHER, d);
+                        }
+                        struct term *rv = new_term(TT_CATCH, d);
+                        rv->u.catch.body = restd.vec[0];
+                        return rv;
+                }
+                if (is_this_symbol(head, "DELAY")) {
+                        struct list_data restd = get_list_data(rest);
+                        if (restd.n != 1 || !is_NIL(restd.terminator)) {
+                                return new_term(TT_OTHER, d);
+                        }
+                        struct term *rv = new_term(TT_DELAY, d);
+                        rv->u.delay.lambda =
+                                make_pair(make_symbolic_atom_cstr("LAMBDA"),
+                                          make_pair(make_NIL(), rest));
+                        return rv;
+                }
+                if (is_this_symbol(head, "DO")) {
+                        struct list_data restd = get_list_data(rest);
+                        if ((restd.n != 2 && restd.n != 3) ||
+                            !is_NIL(restd.terminator)) {
+                                return new_term(TT_OTHER, d);
+                        }
+                        struct list_data vd = get_list_data(restd.vec[0]);
+                        struct list_data td = get_list_data(restd.vec[1]);
+                        if (!is_NIL(vd.terminator) ||
+                            td.n != 2 || !is_NIL(td.terminator)) {
+                                return new_term(TT_OTHER, d);
+                        }
+                        struct term *rv = new_term(TT_LOOP, d);
+                        struct loop_term *lt = &rv->u.loop;
+                        lt->num_vars = vd.n;
+                        lt->vars = alloc_object(vd.n * sizeof *lt->vars);
+                        lt->inits = alloc_object(vd.n * sizeof *lt->inits);
+                        lt->steps = alloc_object(vd.n * sizeof *lt->steps);
+                        lt->test = td.vec[0];
+                        lt->result = td.vec[1];
+                        lt->body = restd.n == 3 ? restd.vec[2] : NULL;
+                        lt->frame_vars = !may_capture_env(restd.vec[1]) &&
+                                (lt->body == NULL ||
+                                 !may_capture_env(lt->body));
+                        for (size_t i = 0; i < vd.n; i++) {
+                                struct list_data bd = get_list_data(vd.vec[i]);
+                                if ((bd.n != 2 && bd.n != 3) ||
+                                    !is_NIL(bd.terminator) ||
+                                    get_type(bd.vec[0]) != T_SYMBOL) {
+                                        return new_term(TT_OTHER, d);
+                                }
+                                lt->vars[i] = get_symbol_name(bd.vec[0]);
+                                note_primop_binding(lt->vars[i], NULL);
+                                lt->inits[i] = bd.vec[1];
+                                lt->steps[i] = bd.n == 3 ? bd.vec[2] : NULL;
+                                if (lt->steps[i] != NULL &&
+                                    may_capture_env(lt->steps[i])) {
+                                        lt->frame_vars = false;
+                                }
+                        }
+                        alloc_keep_alive(vd.vec);
+                        return rv;
+                }
                 if (is_this_symbol(head, "LAMBDA")) {
                         struct list_data restd = get_list_data(rest);
                         if (restd.n != 2 || !is_NIL(restd.terminator)) {
@@ -98,6 +184,8 @@ static struct term *parse_list(struct datum *d)
                                         return new_term(TT_OTHER, d);
                                 }
                                 str_vec_append(sv, get_symbol_name(var));
+                                note_primop_binding(get_symbol_name(var),
+                                                    NULL);
                                 vd = get_pair_second(vd);
                         }
                         rv->u.abs.num_params = str_vec_len(sv);
@@ -106,9 +194,13 @@ static struct term *parse_list(struct datum *d)
                                 rv->u.abs.rest_param_name = NULL;
                         } else if (get_type(vd) == T_SYMBOL) {
                                 rv->u.abs.rest_param_name = get_symbol_name(vd);
+                                note_primop_binding(get_symbol_name(vd), NULL);
                         } else {
                                 return new_term(TT_OTHER, d);
                         }
+                        rv->u.abs.frame_args =
+                                rv->u.abs.rest_param_name == NULL &&
+                                !may_capture_env(rv->u.abs.body);
                         return rv;
                 }
                 if (is_this_symbol(head, "COND")) {
@@ -123,8 +215,8 @@ static struct term *parse_list(struct datum *d)
                                 if (pd.n != 2 || !is_NIL(pd.terminator)) {
                                         return new_term(TT_OTHER, d);
                                 }
-                                struct guarded_term *gt = GC_malloc(sizeof *gt);
-                                if (gt == NULL) enomem();
+                                struct guarded_term *gt =
+                                        alloc_object_of(ALLOC_TERM, sizeof *gt);
                                 gt->guard = pd.vec[0];
                                 gt->term = pd.vec[1];
                                 gt->next = NULL;
@@ -157,8 +249,8 @@ static struct term *parse_list(struct datum *d)
                                 if (get_type(pd.vec[0]) != T_SYMBOL) {
                                         return new_term(TT_OTHER, d);
                                 }
-                                struct define_term *dt = GC_malloc(sizeof *dt);
-                                if (dt == NULL) enomem();
+                                struct define_term *dt =
+                                        alloc_object_of(ALLOC_TERM, sizeof *dt);
                                 dt->name = get_symbol_name(pd.vec[0]);
                                 dt->binding = pd.vec[1];
                                 dt->next = NULL;
@@ -184,11 +276,13 @@ static struct term *parse_list(struct datum *d)
         return rv;
 }
 
-struct term *parse_sexp_as_term(struct datum *d)
+static struct term *parse_uncached(struct datum *d)
 {
         struct term *rv;
         switch (get_type(d)) {
-        case T_ERROR: case T_PRIMITIVE: case T_NUMBER: case T_CLOSURE:
+        case T_ERROR: case T_PRIMITIVE: case T_NUMBER: case T_INTEGER:
+        case T_CLOSURE: case T_HASH: case T_F64VEC: case T_VECTOR:
+        case T_PROMISE:
                 rv = new_term(TT_DATA, d);
                 rv->u.data.d = d;
                 return rv;
@@ -202,6 +296,46 @@ struct term *parse_sexp_as_term(struct datum *d)
         NOTREACHED;
 }
 
+/* Terms are parsed again every time they are evaluated, so recent
+   parses are remembered in a cache keyed by the address of the
+   S-expression.  Besides saving the parse, this keeps the state that
+   the evaluator attaches to terms (see quicken in eval.c), so the cache
+   is set-associative: each address maps to a set of PARSE_CACHE_WAYS
+   terms, most recently used first, and only the least recently used
+   one is replaced.  A cached term keeps its S-expression alive, so the
+   address cannot be reused for another datum while it is cached.
+   Fixnums are not cached: they are not at an address of their own, and
+   equal ones are the same datum anyway, so they would only evict the
+   terms around them.  The evaluator does not parse them (see
+   eval_datum in eval.c).
+ */
+#define PARSE_CACHE_BITS 11     // of the number of sets
+#define PARSE_CACHE_WAYS 4
+
+static struct term *parse_cache[1 << PARSE_CACHE_BITS][PARSE_CACHE_WAYS];
+
+struct term *parse_sexp_as_term(struct datum *d)
+{
+        if (is_fixnum(d)) return parse_uncached(d);
+        // all bits of the address matter, tag bits included
+        size_t h = (uint64_t)(uintptr_t)d * UINT64_C(0x9e3779b97f4a7c15)
+                >> (64 - PARSE_CACHE_BITS);
+        struct term **set = parse_cache[h];
+        struct term *rv = set[0];
+        if (rv != NULL && rv->orig == d) return rv;
+        size_t i = 1;
+        while (i < PARSE_CACHE_WAYS - 1 &&
+               (set[i] == NULL || set[i]->orig != d)) {
+                i++;
+        }
+        rv = set[i];
+        if (rv == NULL || rv->orig != d) rv = parse_uncached(d);
+        // move it to the front, dropping the last if it was a miss
+        memmove(set + 1, set, i * sizeof *set);
+        set[0] = rv;
+        return rv;
+}
+
 enum term_type get_term_type(struct term *t)
 {
         return t->type;
@@ -259,3 +393,23 @@ struct define_term *term_as_define_term(struct term *t)
         return t->u.define;
 }
 
+// defined for TT_CATCH
+struct catch_term *term_as_catch_term(struct term *t)
+{
+        assert(t->type == TT_CATCH);
+        return &t->u.catch;
+}
+
+// defined for TT_LOOP
+struct loop_term *term_as_loop_term(struct term *t)
+{
+        assert(t->type == TT_LOOP);
+        return &t->u.loop;
+}
+
+// defined for TT_DELAY
+struct delay_term *term_as_delay_term(struct term *t)
+{
+        assert(t->type == TT_DELAY);
+        return &t->u.delay;
+}
@@ -45,10 +45,14 @@ enum term_type {
         TT_GUARDED,
         // extensions
         TT_DEFINE,
+        TT_CATCH,
+        TT_LOOP,
+        TT_DELAY,
 };
 
 
 struct term;
+struct quick_app;
 
 // used for both variables
 struct var_term {
@@ -63,6 +67,9 @@ struct data_term {
 struct app_term {
         struct datum *left;
         struct datum *right;
+        // what eval_term made of the call when it first evaluated it
+        // (see quicken in eval.c), or NULL
+        struct quick_app *quick;
 };
 
 /*
@@ -82,12 +89,17 @@ struct app_term {
      params[0] is x
      params[1] is y
      rest_param_name is z
+
+  frame_args is true if there is no rest parameter and the body cannot
+  capture the environment of a call (it contains no LAMBDA, LABEL or
+  DEFINE), so that the arguments need not outlive the call.
  */
 struct abs_term {
         size_t num_params;
         const char **params;
         const char *rest_param_name;
         struct datum *body;
+        _Bool frame_args;
 };
 
 struct mu_term {
@@ -107,6 +119,41 @@ struct define_term {
         struct define_term *next;
 }; 
 
+// (CATCH body)
+struct catch_term {
+        struct datum *body;
+};
+
+/*
+  (DO ((i 0 (add i 1)) (acc 1)) ((eq i 5) acc) body) ->
+     num_vars == 2
+     vars[0] is i, inits[0] is 0, steps[0] is (add i 1)
+     vars[1] is acc, inits[1] is 1, steps[1] == NULL
+     test is (eq i 5)
+     result is acc
+     body is body (NULL if the form has none)
+
+  frame_vars is true if the test, the result, the body and the steps
+  cannot capture the environment (see frame_args above), so that the
+  variables can be updated in place in a single frame.
+ */
+struct loop_term {
+        size_t num_vars;
+        const char **vars;
+        struct datum **inits;
+        struct datum **steps;
+        struct datum *test;
+        struct datum *result;
+        struct datum *body;
+        _Bool frame_vars;
+};
+
+/* (DELAY expr) -> lambda is (LAMBDA () expr), the function whose value
+   the promise made by the term is */
+struct delay_term {
+        struct datum *lambda;
+};
+
 struct term *parse_sexp_as_term(struct datum *);
 
 enum term_type get_term_type(struct term *);
@@ -134,4 +181,13 @@ struct guarded_term *term_as_guarded_term(struct term *);
 // defined for TT_DEFINE
 struct define_term *term_as_define_term(struct term *);
 
+// defined for TT_CATCH
+struct catch_term *term_as_catch_term(struct term *);
+
+// defined for TT_LOOP
+struct loop_term *term_as_loop_term(struct term *);
+
+// defined for TT_DELAY
+struct delay_term *term_as_delay_term(struct term *);
+
 #endif /* GUARD_AST_H */
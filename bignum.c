@@ -0,0 +1,351 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "bignum.h"
+
+/* Magnitudes are stored as little-endian arrays of 32-bit digits with
+   no leading (most significant) zero digits.  Zero has no digits and
+   sign 0. */
+struct bignum {
+        int sign;
+        size_t n;
+        uint32_t d[];
+};
+
+#define BASE ((uint64_t)1 << 32)
+
+static struct bignum *bn_alloc(size_t n)
+{
+        struct bignum *rv = alloc_atomic(sizeof *rv + n * sizeof *rv->d);
+        rv->sign = 0;
+        rv->n = n;
+        return rv;
+}
+
+// drops leading zero digits and fixes the sign of zero
+static struct bignum *bn_trim(struct bignum *b, int sign)
+{
+        while (b->n > 0 && b->d[b->n - 1] == 0) b->n--;
+        b->sign = b->n == 0 ? 0 : sign;
+        return b;
+}
+
+struct bignum *bignum_from_int64(int64_t v)
+{
+        uint64_t mag = v < 0 ? -(uint64_t)v : (uint64_t)v;
+        struct bignum *rv = bn_alloc(2);
+        rv->d[0] = (uint32_t)mag;
+        rv->d[1] = (uint32_t)(mag >> 32);
+        return bn_trim(rv, v < 0 ? -1 : 1);
+}
+
+// b = b*mul + add, in place; b must have room for one more digit
+static void mag_mul_add_small(struct bignum *b, uint32_t mul, uint32_t add)
+{
+        uint64_t carry = add;
+        for (size_t i = 0; i < b->n; i++) {
+                uint64_t t = (uint64_t)b->d[i] * mul + carry;
+                b->d[i] = (uint32_t)t;
+                carry = t >> 32;
+        }
+        if (carry != 0) b->d[b->n++] = (uint32_t)carry;
+}
+
+// b = b / div, in place; returns the remainder
+static uint32_t mag_div_small(struct bignum *b, uint32_t div)
+{
+        uint64_t rem = 0;
+        for (size_t i = b->n; i-- > 0; ) {
+                uint64_t t = (rem << 32) | b->d[i];
+                b->d[i] = (uint32_t)(t / div);
+                rem = t % div;
+        }
+        while (b->n > 0 && b->d[b->n - 1] == 0) b->n--;
+        return (uint32_t)rem;
+}
+
+struct bignum *bignum_from_decimal(const char *s, size_t len)
+{
+        // each decimal digit needs less than four bits
+        struct bignum *rv = bn_alloc(len / 8 + 2);
+        rv->n = 0;
+        size_t i = 0;
+        while (i < len) {
+                // consume up to nine digits at a time
+                uint32_t chunk = 0;
+                uint32_t mul = 1;
+                for (size_t k = 0; k < 9 && i < len; k++, i++) {
+                        assert(s[i] >= '0' && s[i] <= '9');
+                        chunk = 10 * chunk + (uint32_t)(s[i] - '0');
+                        mul *= 10;
+                }
+                mag_mul_add_small(rv, mul, chunk);
+        }
+        return bn_trim(rv, 1);
+}
+
+bool bignum_to_int64(const struct bignum *b, int64_t *out)
+{
+        if (b->n > 2) return false;
+        uint64_t mag = 0;
+        if (b->n > 0) mag = b->d[0];
+        if (b->n > 1) mag |= (uint64_t)b->d[1] << 32;
+        if (b->sign >= 0) {
+                if (mag > INT64_MAX) return false;
+                *out = (int64_t)mag;
+        } else {
+                if (mag > (uint64_t)INT64_MAX + 1) return false;
+                *out = mag == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)mag;
+        }
+        return true;
+}
+
+double bignum_to_double(const struct bignum *b)
+{
+        double rv = 0;
+        for (size_t i = b->n; i-- > 0; ) rv = rv * (double)BASE + b->d[i];
+        return b->sign < 0 ? -rv : rv;
+}
+
+char *bignum_to_decimal(const struct bignum *b)
+{
+        if (b->sign == 0) {
+                char *rv = alloc_atomic(2);
+                strcpy(rv, "0");
+                return rv;
+        }
+        struct bignum *t = bn_alloc(b->n);
+        memcpy(t->d, b->d, b->n * sizeof *t->d);
+        // collect base 10^9 chunks, least significant first; each
+        // chunk takes at least 29 bits off the magnitude
+        size_t nchunks = 0;
+        uint32_t *chunks = alloc_atomic((b->n * 32 / 29 + 1) * sizeof *chunks);
+        while (t->n > 0) chunks[nchunks++] = mag_div_small(t, 1000000000);
+        char *rv = alloc_atomic(nchunks * 9 + 2);
+        char *p = rv;
+        if (b->sign < 0) *p++ = '-';
+        p += sprintf(p, "%u", (unsigned)chunks[nchunks - 1]);
+        for (size_t i = nchunks - 1; i-- > 0; ) {
+                p += sprintf(p, "%09u", (unsigned)chunks[i]);
+        }
+        return rv;
+}
+
+static int mag_cmp(const struct bignum *a, const struct bignum *b)
+{
+        if (a->n != b->n) return a->n < b->n ? -1 : 1;
+        for (size_t i = a->n; i-- > 0; ) {
+                if (a->d[i] != b->d[i]) return a->d[i] < b->d[i] ? -1 : 1;
+        }
+        return 0;
+}
+
+int bignum_cmp(const struct bignum *a, const struct bignum *b)
+{
+        if (a->sign != b->sign) return a->sign < b->sign ? -1 : 1;
+        int c = mag_cmp(a, b);
+        return a->sign < 0 ? -c : c;
+}
+
+bool bignum_is_zero(const struct bignum *b)
+{
+        return b->sign == 0;
+}
+
+static struct bignum *mag_add(const struct bignum *a, const struct bignum *b,
+                              int sign)
+{
+        if (a->n < b->n) {
+                const struct bignum *t = a;
+                a = b;
+                b = t;
+        }
+        struct bignum *rv = bn_alloc(a->n + 1);
+        uint64_t carry = 0;
+        for (size_t i = 0; i < a->n; i++) {
+                uint64_t t = (uint64_t)a->d[i] + carry;
+                if (i < b->n) t += b->d[i];
+                rv->d[i] = (uint32_t)t;
+                carry = t >> 32;
+        }
+        rv->d[a->n] = (uint32_t)carry;
+        return bn_trim(rv, sign);
+}
+
+// requires |a| >= |b|
+static struct bignum *mag_sub(const struct bignum *a, const struct bignum *b,
+                              int sign)
+{
+        struct bignum *rv = bn_alloc(a->n);
+        int64_t borrow = 0;
+        for (size_t i = 0; i < a->n; i++) {
+                int64_t t = (int64_t)a->d[i] - borrow;
+                if (i < b->n) t -= b->d[i];
+                borrow = t < 0;
+                rv->d[i] = (uint32_t)(t + (borrow ? (int64_t)BASE : 0));
+        }
+        assert(borrow == 0);
+        return bn_trim(rv, sign);
+}
+
+// a + sign*b
+static struct bignum *add_signed(const struct bignum *a,
+                                 const struct bignum *b, int bsign)
+{
+        if (bsign == 0) return (struct bignum *)a;
+        if (a->sign == 0) {
+                struct bignum *rv = bn_alloc(b->n);
+                memcpy(rv->d, b->d, b->n * sizeof *rv->d);
+                return bn_trim(rv, bsign);
+        }
+        if (a->sign == bsign) return mag_add(a, b, bsign);
+        int c = mag_cmp(a, b);
+        if (c >= 0) return mag_sub(a, b, a->sign);
+        return mag_sub(b, a, bsign);
+}
+
+struct bignum *bignum_add(const struct bignum *a, const struct bignum *b)
+{
+        return add_signed(a, b, b->sign);
+}
+
+struct bignum *bignum_sub(const struct bignum *a, const struct bignum *b)
+{
+        return add_signed(a, b, -b->sign);
+}
+
+struct bignum *bignum_mul(const struct bignum *a, const struct bignum *b)
+{
+        struct bignum *rv = bn_alloc(a->n + b->n);
+        memset(rv->d, 0, rv->n * sizeof *rv->d);
+        for (size_t i = 0; i < a->n; i++) {
+                uint64_t carry = 0;
+                for (size_t j = 0; j < b->n; j++) {
+                        uint64_t t = (uint64_t)a->d[i] * b->d[j]
+                                + rv->d[i + j] + carry;
+                        rv->d[i + j] = (uint32_t)t;
+                        carry = t >> 32;
+                }
+                rv->d[i + b->n] = (uint32_t)carry;
+        }
+        return bn_trim(rv, a->sign * b->sign);
+}
+
+/* Long division of magnitudes (Knuth, TAOCP vol. 2, 4.3.1, Algorithm
+   D); requires v->n >= 2 and u->n >= v->n. */
+static void mag_divmod(const struct bignum *u, const struct bignum *v,
+                       struct bignum **qout, struct bignum **rout)
+{
+        size_t n = v->n;
+        size_t m = u->n - n;
+        // normalize so that the top digit of the divisor has its
+        // high bit set
+        int s = __builtin_clz(v->d[n - 1]);
+        uint32_t *vn = alloc_atomic(n * sizeof *vn);
+        uint32_t *un = alloc_atomic((m + n + 1) * sizeof *un);
+        for (size_t i = n - 1; i > 0; i--) {
+                vn[i] = (v->d[i] << s)
+                        | (s ? v->d[i - 1] >> (32 - s) : 0);
+        }
+        vn[0] = v->d[0] << s;
+        un[m + n] = s ? u->d[m + n - 1] >> (32 - s) : 0;
+        for (size_t i = m + n - 1; i > 0; i--) {
+                un[i] = (u->d[i] << s) | (s ? u->d[i - 1] >> (32 - s) : 0);
+        }
+        un[0] = u->d[0] << s;
+
+        struct bignum *q = bn_alloc(m + 1);
+        for (size_t j = m + 1; j-- > 0; ) {
+                uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+                uint64_t qhat = num / vn[n - 1];
+                uint64_t rhat = num % vn[n - 1];
+                while (qhat >= BASE
+                       || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+                        qhat--;
+                        rhat += vn[n - 1];
+                        if (rhat >= BASE) break;
+                }
+                // multiply and subtract
+                int64_t k = 0;
+                int64_t t;
+                for (size_t i = 0; i < n; i++) {
+                        uint64_t p = qhat * vn[i];
+                        t = (int64_t)un[i + j] - k - (int64_t)(p & 0xFFFFFFFF);
+                        un[i + j] = (uint32_t)t;
+                        k = (int64_t)(p >> 32) - (t >> 32);
+                }
+                t = (int64_t)un[j + n] - k;
+                un[j + n] = (uint32_t)t;
+                if (t < 0) {
+                        // qhat was one too large; add the divisor back
+                        qhat--;
+                        uint64_t c = 0;
+                        for (size_t i = 0; i < n; i++) {
+                                uint64_t a = (uint64_t)un[i + j] + vn[i] + c;
+                                un[i + j] = (uint32_t)a;
+                                c = a >> 32;
+                        }
+                        un[j + n] += (uint32_t)c;
+                }
+                q->d[j] = (uint32_t)qhat;
+        }
+        struct bignum *r = bn_alloc(n);
+        for (size_t i = 0; i < n - 1; i++) {
+                r->d[i] = (un[i] >> s) | (s ? un[i + 1] << (32 - s) : 0);
+        }
+        r->d[n - 1] = un[n - 1] >> s;
+        *qout = bn_trim(q, 1);
+        *rout = bn_trim(r, 1);
+}
+
+void bignum_divmod(const struct bignum *a, const struct bignum *b,
+                   struct bignum **q, struct bignum **r)
+{
+        assert(b->sign != 0);
+        if (mag_cmp(a, b) < 0) {
+                *q = bn_alloc(0);
+                *r = (struct bignum *)a;
+                return;
+        }
+        struct bignum *qq, *rr;
+        if (b->n == 1) {
+                qq = bn_alloc(a->n);
+                memcpy(qq->d, a->d, a->n * sizeof *qq->d);
+                rr = bn_alloc(1);
+                rr->d[0] = mag_div_small(qq, b->d[0]);
+        } else {
+                mag_divmod(a, b, &qq, &rr);
+        }
+        *q = bn_trim(qq, a->sign * b->sign);
+        *r = bn_trim(rr, a->sign);
+}
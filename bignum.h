@@ -0,0 +1,70 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+ 
+#ifndef GUARD_BIGNUM_H
+#define GUARD_BIGNUM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Arbitrary-precision integers.  Bignums are immutable; every
+   operation returns a freshly allocated result (or one of its
+   arguments, when that is the answer). */
+struct bignum;
+
+struct bignum *bignum_from_int64(int64_t);
+
+/* Parses a nonempty string of decimal digits. */
+struct bignum *bignum_from_decimal(const char *s, size_t len);
+
+/* If the value fits in an int64_t, stores it in *out and returns
+   true; otherwise returns false and does not touch *out. */
+bool bignum_to_int64(const struct bignum *, int64_t *out);
+
+double bignum_to_double(const struct bignum *);
+
+/* Returns the decimal representation as a freshly allocated string. */
+char *bignum_to_decimal(const struct bignum *);
+
+/* Returns a negative number, zero or a positive number as a is less
+   than, equal to or greater than b. */
+int bignum_cmp(const struct bignum *a, const struct bignum *b);
+
+bool bignum_is_zero(const struct bignum *);
+
+struct bignum *bignum_add(const struct bignum *, const struct bignum *);
+struct bignum *bignum_sub(const struct bignum *, const struct bignum *);
+struct bignum *bignum_mul(const struct bignum *, const struct bignum *);
+
+/* Truncating division: a = q*b + r with |r| < |b| and r having the
+   sign of a.  b must not be zero. */
+void bignum_divmod(const struct bignum *a, const struct bignum *b,
+                   struct bignum **q, struct bignum **r);
+
+#endif /* GUARD_BIGNUM_H */
@@ -0,0 +1,1457 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "alloc.h"
+#include "ast.h"
+#include "compile.h"
+#include "error.h"
+#include "eval.h"
+#include "number.h"
+#include "primops.h"
+#include "timeline.h"
+
+typedef struct datum *(*run_fun)(struct code *, struct env *);
+
+struct code {
+        run_fun run;
+        struct datum *orig;
+        union {
+                const char *var;
+                size_t slot; // run_slot
+                struct {
+                        const char *var;
+                        // the names captured by the lambda whose body
+                        // this is, and the index of var among them
+                        const char **names;
+                        size_t index;
+                } captured;
+                struct {
+                        struct code *fun;
+                        size_t argc;
+                        struct code **argv;
+                        // terminator of an improper argument list, or NULL
+                        struct code *rest;
+                        // for run_app_prim: the primitive fun is
+                        // expected to evaluate to, and whether its
+                        // name may have been bound to anything else
+                        prim_fun prim;
+                        fast_fun fast;
+                        const _Bool *rebound;
+                        // for run_inline: the body of the lambda called
+                        // and its parameters; the environment it runs
+                        // in (NULL for the caller's); and whether the
+                        // name of the function has been bound to
+                        // anything else (NULL if it is not named)
+                        struct code *inline_body;
+                        const char **params;
+                        struct env *inline_env;
+                        const bool *changed;
+                } app;
+                struct {
+                        size_t n;
+                        struct code **guards;
+                        struct code **terms;
+                        // for run_cond_table: the variable compared by
+                        // the first prefix clauses, the key each of
+                        // them compares it to (NULL if it never
+                        // matches), the hashed keys, and whether EQ may
+                        // have been rebound
+                        struct code *var;
+                        size_t prefix;
+                        struct datum **keys;
+                        struct cond_slot *table;
+                        size_t mask;
+                        const _Bool *rebound;
+                } cond;
+                struct {
+                        size_t num_params;
+                        const char **params;
+                        const char *rest_param_name;
+                        struct code *body;
+                        // the numeric specialization, or NULL
+                        struct numeric_fn *num;
+                        // the free variables to capture (see
+                        // run_lambda); captured == NULL if the closure
+                        // keeps the whole environment
+                        size_t num_captured;
+                        const char **captured;
+                } lambda;
+                struct {
+                        const char *var;
+                        struct code *body;
+                } mu;
+                struct code *body; // CATCH and DELAY
+                struct {
+                        size_t n;
+                        const char **vars;
+                        struct code **inits;
+                        struct code **steps; // NULL where there is none
+                        struct code *test;
+                        struct code *result;
+                        struct code *body; // or NULL
+                        bool frame;
+                } loop;
+                struct {
+                        size_t n;
+                        const char **names;
+                        struct code **bindings;
+                } define;
+        } u;
+};
+
+static inline struct datum *run(struct code *c, struct env *env)
+{
+        return c->run(c, env);
+}
+
+/* Numeric specialization.  A function bound by DEFINE or LABEL whose
+   body does nothing but arithmetic on its parameters and numeric
+   constants, COND on EQ comparisons of numbers, and calls of itself
+   also gets a tree of struct ncode nodes (see numeric_compile) that
+   computes on unboxed numbers.  A call of such a function whose
+   arguments are all fixnums or floating-point numbers runs on that
+   tree: the recursive calls pass unboxed values without binding them
+   in environments, and only the final result is boxed.
+
+   The specialized path gives up if an integer result leaves the
+   fixnum range, if ADD, SUB, MUL, DIV or EQ may have been rebound
+   (see note_primop_binding in primops.h), or if the name of the
+   function no longer denotes it.  The call is then made again on the
+   generic path, which is safe since the function has no side effects.
+   A function whose specialization fails, or is bypassed because of
+   the arguments, NUMERIC_CREDIT more times than it succeeds loses it.
+ */
+#define MAX_NUMERIC_PARAMS 8
+#define NUMERIC_CREDIT 16
+
+struct nval {
+        _Bool is_int;
+        union {
+                int64_t i;
+                double d;
+        } u;
+};
+
+enum nop { N_CONST, N_PARAM, N_ADD, N_SUB, N_MUL, N_DIV, N_EQ, N_COND,
+           N_SELF };
+
+struct ncode {
+        enum nop op;
+        struct nval k;          // N_CONST
+        size_t index;           // N_PARAM
+        struct ncode *a, *b;    // N_ADD to N_EQ
+        // N_COND: the clauses, a NULL guard being always true;
+        // N_SELF: the arguments, in terms
+        size_t n;
+        struct ncode **guards;
+        struct ncode **terms;
+};
+
+struct numeric_fn {
+        const char *name;
+        size_t num_params;
+        struct ncode *body;
+        int credit;
+};
+
+// the rebound flags of ADD, SUB, MUL, DIV and EQ
+static const _Bool *arith_rebound[5];
+
+static _Bool arith_may_be_rebound(void)
+{
+        for (size_t i = 0; i < 5; i++) {
+                if (*arith_rebound[i]) return true;
+        }
+        return false;
+}
+
+static double nval_double(struct nval x)
+{
+        return x.is_int ? (double)x.u.i : x.u.d;
+}
+
+// the same rules as number_add and friends in number.c
+static _Bool narith(enum nop op, struct nval x, struct nval y,
+                    struct nval *out)
+{
+        if (x.is_int && y.is_int) {
+                int64_t r;
+                switch (op) {
+                case N_ADD:
+                        if (__builtin_add_overflow(x.u.i, y.u.i, &r)) {
+                                return false;
+                        }
+                        break;
+                case N_SUB:
+                        if (__builtin_sub_overflow(x.u.i, y.u.i, &r)) {
+                                return false;
+                        }
+                        break;
+                case N_MUL:
+                        if (__builtin_mul_overflow(x.u.i, y.u.i, &r)) {
+                                return false;
+                        }
+                        break;
+                case N_DIV:
+                        if (y.u.i == 0 || x.u.i % y.u.i != 0) goto inexact;
+                        r = x.u.i / y.u.i;
+                        break;
+                default:
+                        NOTREACHED;
+                }
+                if (!fixnum_in_range(r)) return false;
+                out->is_int = true;
+                out->u.i = r;
+                return true;
+        }
+inexact:
+        out->is_int = false;
+        double a = nval_double(x);
+        double b = nval_double(y);
+        switch (op) {
+        case N_ADD: out->u.d = a + b; break;
+        case N_SUB: out->u.d = a - b; break;
+        case N_MUL: out->u.d = a * b; break;
+        case N_DIV: out->u.d = a / b; break;
+        default: NOTREACHED;
+        }
+        return true;
+}
+
+// the chosen term of a COND and a call of the function in tail
+// position are run in a loop, so deep tail recursion needs no stack
+static _Bool nrun(struct ncode *c, struct numeric_fn *fn,
+                  const struct nval *args, struct nval *out)
+{
+        struct nval frame[MAX_NUMERIC_PARAMS];
+        while (true) {
+        switch (c->op) {
+        case N_CONST:
+                *out = c->k;
+                return true;
+        case N_PARAM:
+                *out = args[c->index];
+                return true;
+        case N_ADD: case N_SUB: case N_MUL: case N_DIV:
+        {
+                struct nval x, y;
+                return nrun(c->a, fn, args, &x) && nrun(c->b, fn, args, &y)
+                        && narith(c->op, x, y, out);
+        }
+        case N_EQ:
+                // only appears as a guard
+                NOTREACHED;
+        case N_COND:
+        {
+                // the last guard is always true
+                size_t i = 0;
+                for (struct ncode *g; (g = c->guards[i]) != NULL; i++) {
+                        struct nval x, y;
+                        if (!nrun(g->a, fn, args, &x) ||
+                            !nrun(g->b, fn, args, &y)) {
+                                return false;
+                        }
+                        if (x.is_int && y.is_int
+                            ? x.u.i == y.u.i
+                            : nval_double(x) == nval_double(y)) {
+                                break;
+                        }
+                }
+                c = c->terms[i];
+                continue;
+        }
+        case N_SELF:
+        {
+                eval_step();
+                struct nval a[MAX_NUMERIC_PARAMS];
+                for (size_t i = 0; i < c->n; i++) {
+                        if (!nrun(c->terms[i], fn, args, &a[i])) return false;
+                }
+                memcpy(frame, a, c->n * sizeof *a);
+                args = frame;
+                c = fn->body;
+                continue;
+        }
+        }
+        NOTREACHED;
+        }
+}
+
+/* Calls the closure fun, whose code is lc, on the specialized path
+   with the arguments in vals.  Returns NULL if that cannot be done. */
+static struct datum *numeric_call(struct datum *fun, struct code *lc,
+                                  struct datum **vals)
+{
+        struct numeric_fn *fn = lc->u.lambda.num;
+        struct nval args[MAX_NUMERIC_PARAMS];
+        struct nval out;
+        struct datum *self;
+        if (arith_may_be_rebound()) goto fail;
+        for (size_t i = 0; i < fn->num_params; i++) {
+                if (is_fixnum(vals[i])) {
+                        args[i].is_int = true;
+                        args[i].u.i = get_fixnum_value(vals[i]);
+                } else if (get_type(vals[i]) == T_NUMBER) {
+                        args[i].is_int = false;
+                        args[i].u.d = get_numeric_value(vals[i]);
+                } else {
+                        goto fail;
+                }
+        }
+        // no binding can change while the specialized code runs, so
+        // this is the only check needed for the recursive calls
+        if (!env_lookup(get_closure_env(fun), fn->name, &self) ||
+            self != fun) {
+                goto fail;
+        }
+        if (!nrun(fn->body, fn, args, &out)) goto fail;
+        if (fn->credit < NUMERIC_CREDIT) fn->credit++;
+        return out.is_int
+                ? make_integer_atom(out.u.i)
+                : make_numeric_atom(out.u.d);
+fail:
+        if (--fn->credit <= 0) {
+                lc->u.lambda.num = NULL;
+        }
+        return NULL;
+}
+
+struct datum *code_apply(struct datum *fun, struct datum *arg)
+{
+        struct code *lc = get_closure_code(fun);
+        if (lc->u.lambda.num != NULL) {
+                struct list_data ld = get_list_data(arg);
+                if (ld.n == lc->u.lambda.num_params &&
+                    is_NIL(ld.terminator)) {
+                        struct datum *rv = numeric_call(fun, lc, ld.vec);
+                        if (rv != NULL) return rv;
+                }
+        }
+        struct env *env = env_clone(get_closure_env(fun));
+        struct datum *it = arg;
+        for (size_t i = 0; i < lc->u.lambda.num_params; i++) {
+                if (get_type(it) != T_PAIR) {
+                        raise_error(make_pair(fun, arg),
+                                    "Missing a parameter for %s",
+                                    lc->u.lambda.params[i]);
+                }
+                env_bind(env, lc->u.lambda.params[i], get_pair_first(it));
+                it = get_pair_second(it);
+        }
+        if (lc->u.lambda.rest_param_name != NULL) {
+                env_bind(env, lc->u.lambda.rest_param_name, it);
+        } else if (!is_NIL(it)) {
+                raise_error(make_pair(fun, arg), "Too many parameters");
+        }
+        return run(lc->u.lambda.body, env);
+}
+
+static struct datum *run_other(struct code *c, struct env *env)
+{
+        (void)env;
+        raise_error(c->orig, "ERROR: Cannot evaluate");
+}
+
+static struct datum *run_data(struct code *c, struct env *env)
+{
+        (void)env;
+        return c->orig;
+}
+
+static struct datum *lookup(struct code *c, const char *name,
+                            struct env *env)
+{
+        struct datum *def;
+        if (!env_lookup(env, name, &def)) {
+                raise_error(c->orig, "ERROR: Undefined variable");
+        }
+        if (is_blackhole(def)) raise_error_value(def);
+        return def;
+}
+
+static struct datum *run_var(struct code *c, struct env *env)
+{
+        return lookup(c, c->u.var, env);
+}
+
+/* A free variable of a converted lambda (see run_lambda), read by
+   index unless the closure has fallen back to keeping its whole
+   environment. */
+static struct datum *run_captured(struct code *c, struct env *env)
+{
+        if (env->captured_names == c->u.captured.names) {
+                return env->captured_vals[c->u.captured.index];
+        }
+        return lookup(c, c->u.captured.var, env);
+}
+
+// a parameter of an inlined lambda (see run_inline)
+static struct datum *run_slot(struct code *c, struct env *env)
+{
+        return env->frame_vals[c->u.slot];
+}
+
+// evaluates the arguments and applies fun to them
+static struct datum *app_args(struct code *c, struct env *env,
+                              struct datum *fun)
+{
+        struct datum *arg = make_NIL();
+        struct datum *last = make_NIL();
+        for (size_t i = 0; i < c->u.app.argc; i++) {
+                struct datum *res = run(c->u.app.argv[i], env);
+                struct datum *n = make_pair(res, make_NIL());
+                if (is_NIL(arg)) {
+                        arg = n;
+                } else {
+                        set_pair_second(last, n);
+                }
+                last = n;
+        }
+        if (c->u.app.rest != NULL) {
+                struct datum *res = run(c->u.app.rest, env);
+                if (is_NIL(arg)) {
+                        arg = res;
+                } else {
+                        set_pair_second(last, res);
+                }
+        }
+        return eval_apply(fun, arg);
+}
+
+// run_app for a compiled closure whose parameters match the arguments
+static struct datum *call_code(struct code *c, struct env *env,
+                               struct datum *fun, struct code *lc)
+{
+        if (lc->u.lambda.num != NULL) {
+                struct datum *vals[MAX_NUMERIC_PARAMS];
+                for (size_t i = 0; i < c->u.app.argc; i++) {
+                        vals[i] = run(c->u.app.argv[i], env);
+                }
+                struct datum *rv = numeric_call(fun, lc, vals);
+                if (rv != NULL) return rv;
+                struct env *nenv = env_clone(get_closure_env(fun));
+                for (size_t i = 0; i < c->u.app.argc; i++) {
+                        env_bind(nenv, lc->u.lambda.params[i], vals[i]);
+                }
+                return run(lc->u.lambda.body, nenv);
+        }
+        // the arguments match the parameters, so they can be bound
+        // as they are evaluated, without building a list
+        struct env *nenv = env_clone(get_closure_env(fun));
+        for (size_t i = 0; i < c->u.app.argc; i++) {
+                struct datum *res = run(c->u.app.argv[i], env);
+                env_bind(nenv, lc->u.lambda.params[i], res);
+        }
+        return run(lc->u.lambda.body, nenv);
+}
+
+static struct datum *app(struct code *c, struct env *env)
+{
+        struct datum *fun = run(c->u.app.fun, env);
+        struct code *lc;
+        if (get_type(fun) != T_CLOSURE ||
+            (lc = get_closure_code(fun)) == NULL ||
+            c->u.app.rest != NULL ||
+            lc->u.lambda.rest_param_name != NULL ||
+            lc->u.lambda.num_params != c->u.app.argc) {
+                return app_args(c, env, fun);
+        }
+        // (app_args counts its step in eval_apply)
+        eval_step();
+        if (!timeline_on) return call_code(c, env, fun, lc);
+        timeline_enter(fun);
+        struct datum *rv = call_code(c, env, fun, lc);
+        timeline_exit();
+        return rv;
+}
+
+// records the call for backtraces, as eval_term does
+static struct datum *run_app(struct code *c, struct env *env)
+{
+        size_t depth = eval_trace_push(c->orig);
+        struct datum *rv = app(c, env);
+        eval_trace_pop(depth);
+        return rv;
+}
+
+/* Inlining.  A call of a small lambda, written in place or bound to a
+   name when the call is compiled, runs a copy of the lambda's body
+   compiled for the call: the arguments go in a frame on the C stack
+   instead of a fresh environment, and the parameters are read from
+   the frame by position (see try_inline).  Free variables of the body
+   are still looked up in the environment of the closure, so scoping
+   is the same as for an ordinary call.  A named function is watched
+   (see env_watch in env.h), and if the name is ever bound to anything
+   else, for example when the function is redefined, the call goes
+   back to the generic path for good.
+ */
+#define MAX_INLINE_PARAMS 8
+#define INLINE_BUDGET 32     // pairs and atoms in the body
+#define MAX_INLINE_DEPTH 4
+
+static struct datum *run_inline(struct code *c, struct env *env)
+{
+        if (c->u.app.changed != NULL && *c->u.app.changed) {
+                c->run = run_app;
+                return run_app(c, env);
+        }
+        eval_step();
+        size_t depth = eval_trace_push(c->orig);
+        struct datum *vals[MAX_INLINE_PARAMS];
+        for (size_t i = 0; i < c->u.app.argc; i++) {
+                vals[i] = run(c->u.app.argv[i], env);
+        }
+        struct env frame;
+        env_init_frame(&frame,
+                       c->u.app.inline_env != NULL ? c->u.app.inline_env : env,
+                       c->u.app.argc, c->u.app.params, vals);
+        struct datum *rv = run(c->u.app.inline_body, &frame);
+        eval_trace_pop(depth);
+        return rv;
+}
+
+// a call of a primitive with a fast path, with one or two arguments
+static struct datum *app_prim(struct code *c, struct env *env)
+{
+        if (*c->u.app.rebound || timeline_on) {
+                // the name may mean something else here, so look it
+                // up; a call on the timeline takes the generic path,
+                // which records it
+                struct datum *fun = run(c->u.app.fun, env);
+                if (timeline_on || get_type(fun) != T_PRIMITIVE ||
+                    get_primitive_fun(fun) != c->u.app.prim) {
+                        return app_args(c, env, fun);
+                }
+        }
+        eval_step();
+        struct datum *a = run(c->u.app.argv[0], env);
+        struct datum *b = NULL;
+        if (c->u.app.argc == 2) {
+                b = run(c->u.app.argv[1], env);
+        }
+        struct datum *rv = c->u.app.fast(a, b);
+        if (rv != NULL) return rv;
+        struct datum *arg = make_NIL();
+        if (b != NULL) arg = make_pair(b, arg);
+        return c->u.app.prim(make_pair(a, arg));
+}
+
+static struct datum *run_app_prim(struct code *c, struct env *env)
+{
+        size_t depth = eval_trace_push(c->orig);
+        struct datum *rv = app_prim(c, env);
+        eval_trace_pop(depth);
+        return rv;
+}
+
+// runs the clauses of c from the first'th on
+static struct datum *run_clauses(struct code *c, struct env *env,
+                                 size_t first)
+{
+        for (size_t i = first; i < c->u.cond.n; i++) {
+                struct datum *test_result = run(c->u.cond.guards[i], env);
+                if (!is_NIL(test_result)) {
+                        return run(c->u.cond.terms[i], env);
+                }
+        }
+        return make_NIL();
+}
+
+static struct datum *run_cond(struct code *c, struct env *env)
+{
+        return run_clauses(c, env, 0);
+}
+
+/* Dispatch on constant keys.  A COND whose first clauses (at least
+   COND_TABLE_MIN of them) all have guards of the form (EQ var key),
+   or (EQ key var), with the same variable and a fixnum constant key
+   compiles them into a hash table from keys to clauses, so that
+   they cost one lookup of the variable and one probe.  The following
+   clauses, typically a catch-all one, are run in order as usual if
+   no key matches.
+
+   A quoted key such as 'ADD evaluates to the QUOTE form, which EQ
+   never finds equal to anything, so its clause is kept in the prefix
+   but never taken.  Should EQ be rebound (see note_primop_binding in
+   primops.h), all the clauses are run in order instead. */
+#define COND_TABLE_MIN 4
+
+struct cond_slot {
+        int64_t key;
+        size_t clause; // SIZE_MAX if the slot is empty
+};
+
+static size_t cond_hash(int64_t key, size_t mask)
+{
+        return (size_t)(((uint64_t)key * UINT64_C(0x9E3779B97F4A7C15)) >> 32)
+                & mask;
+}
+
+static struct datum *run_cond_table(struct code *c, struct env *env)
+{
+        if (*c->u.cond.rebound) return run_clauses(c, env, 0);
+        struct datum *x = run(c->u.cond.var, env);
+        if (is_fixnum(x)) {
+                int64_t key = get_fixnum_value(x);
+                for (size_t h = cond_hash(key, c->u.cond.mask); ;
+                     h = (h + 1) & c->u.cond.mask) {
+                        struct cond_slot *slot = &c->u.cond.table[h];
+                        if (slot->clause == SIZE_MAX) break;
+                        if (slot->key == key) {
+                                return run(c->u.cond.terms[slot->clause], env);
+                        }
+                }
+        } else if (is_number(x)) {
+                // a floating-point number may still equal a key
+                for (size_t i = 0; i < c->u.cond.prefix; i++) {
+                        if (c->u.cond.keys[i] != NULL &&
+                            number_equal(x, c->u.cond.keys[i])) {
+                                return run(c->u.cond.terms[i], env);
+                        }
+                }
+        }
+        return run_clauses(c, env, c->u.cond.prefix);
+}
+
+/* Closure conversion.  A closure made at the top level of a form
+   keeps the environment it is made in, since later top-level DEFINEs
+   must be visible to it.  A lambda nested in another one, on the
+   other hand, can only see the bindings of the environment it is made
+   in as they are then, unless a DEFINE or an unfinished LABEL changes
+   them afterwards.  Such a lambda gets the list of its free variables
+   at compile time (see free_vars), and its closure captures just
+   their values in a flat environment (see make_flat_env) instead of
+   the whole tree, which it would otherwise keep alive.  The body
+   reads the captured variables by index (see run_captured).
+
+   Lambdas in a body that contains a DEFINE are not converted, and a
+   closure whose free variables are not all bound, or are still
+   bound to the black hole of a LABEL or DEFINE, keeps the whole
+   environment as before. */
+static struct env *flat_env(struct code *c, struct env *env)
+{
+        size_t n = c->u.lambda.num_captured;
+        struct datum **vals = n > 0
+                ? alloc_object_of(ALLOC_ARGS, n * sizeof *vals)
+                : NULL;
+        for (size_t i = 0; i < n; i++) {
+                if (!env_lookup(env, c->u.lambda.captured[i], &vals[i]) ||
+                    is_blackhole(vals[i])) {
+                        return env;
+                }
+        }
+        return make_flat_env(n, c->u.lambda.captured, vals);
+}
+
+static struct datum *run_lambda(struct code *c, struct env *env)
+{
+        if (c->u.lambda.captured != NULL) env = flat_env(c, env);
+        struct datum *rv = make_closure(c->orig, env);
+        set_closure_code(rv, c);
+        return rv;
+}
+
+// see the TT_MU case of eval_term
+static struct datum *run_mu(struct code *c, struct env *env)
+{
+        struct env *nenv = env_clone(env);
+        env_bind(nenv, c->u.mu.var, make_blackhole(c->orig,
+                                                   "Infinite recursion."));
+        struct datum *rv = run(c->u.mu.body, nenv);
+        name_closure(rv, c->u.mu.var);
+        env_bind(nenv, c->u.mu.var, rv);
+        return rv;
+}
+
+// see the TT_DEFINE case of eval_term
+static struct datum *run_define(struct code *c, struct env *env)
+{
+        for (size_t i = 0; i < c->u.define.n; i++) {
+                env_bind(env, c->u.define.names[i],
+                         make_blackhole(c->orig,
+                                        "Infinite recursion involving %s",
+                                        c->u.define.names[i]));
+        }
+        for (size_t i = 0; i < c->u.define.n; i++) {
+                struct datum *val = run(c->u.define.bindings[i], env);
+                name_closure(val, c->u.define.names[i]);
+                env_bind(env, c->u.define.names[i], val);
+        }
+        return make_NIL();
+}
+
+// see the TT_DELAY case of eval_term; body makes the closure
+static struct datum *run_delay(struct code *c, struct env *env)
+{
+        return make_promise(run(c->u.body, env), make_NIL());
+}
+
+// see eval_loop in eval.c
+static struct datum *run_loop(struct code *c, struct env *env)
+{
+        size_t n = c->u.loop.n;
+        struct datum **vals = alloc_object_of(ALLOC_ARGS, n * sizeof *vals);
+        for (size_t i = 0; i < n; i++) {
+                vals[i] = run(c->u.loop.inits[i], env);
+        }
+        struct env frame;
+        struct env *lenv = &frame;
+        if (c->u.loop.frame) {
+                env_init_loop_frame(&frame, env, n, c->u.loop.vars, vals);
+        }
+        while (true) {
+                eval_step();
+                if (!c->u.loop.frame) {
+                        lenv = env_clone(env);
+                        for (size_t i = 0; i < n; i++) {
+                                env_bind(lenv, c->u.loop.vars[i], vals[i]);
+                        }
+                }
+                if (!is_NIL(run(c->u.loop.test, lenv))) break;
+                if (c->u.loop.body != NULL) run(c->u.loop.body, lenv);
+                for (size_t i = 0; i < n; i++) {
+                        if (c->u.loop.steps[i] != NULL) {
+                                vals[i] = run(c->u.loop.steps[i], lenv);
+                        }
+                }
+                if (c->u.loop.frame) {
+                        struct datum **cur = frame.frame_vals +
+                                frame.frame_n - n;
+                        for (size_t i = 0; i < n; i++) cur[i] = vals[i];
+                }
+        }
+        return run(c->u.loop.result, lenv);
+}
+
+struct catch_args {
+        struct code *body;
+        struct env *env;
+};
+
+static struct datum *run_catch_body(void *p)
+{
+        struct catch_args *args = p;
+        return run(args->body, args->env);
+}
+
+static struct datum *run_catch(struct code *c, struct env *env)
+{
+        struct catch_args args = { c->u.body, env };
+        return catch_errors(run_catch_body, &args);
+}
+
+static struct code *new_code(run_fun run, struct datum *orig)
+{
+        struct code *rv = alloc_object(sizeof *rv);
+        rv->run = run;
+        rv->orig = orig;
+        return rv;
+}
+
+/* Compiles the body d of the function self with parameters abs for
+   the numeric path, or returns NULL if it does not have the form
+   described above numeric_call. */
+static struct ncode *numeric_compile(struct datum *d, struct abs_term *abs,
+                                     const char *self)
+{
+        struct term *t = parse_sexp_as_term(d);
+        struct ncode *rv = alloc_object(sizeof *rv);
+        switch (get_term_type(t)) {
+        case TT_DATA:
+                if (is_fixnum(d)) {
+                        rv->op = N_CONST;
+                        rv->k.is_int = true;
+                        rv->k.u.i = get_fixnum_value(d);
+                        return rv;
+                }
+                if (get_type(d) == T_NUMBER) {
+                        rv->op = N_CONST;
+                        rv->k.is_int = false;
+                        rv->k.u.d = get_numeric_value(d);
+                        return rv;
+                }
+                return NULL;
+        case TT_VAR:
+                // later parameters shadow earlier ones
+                for (size_t i = abs->num_params; i-- > 0; ) {
+                        if (strcasecmp(abs->params[i],
+                                       term_as_var_term(t)->name) == 0) {
+                                rv->op = N_PARAM;
+                                rv->index = i;
+                                return rv;
+                        }
+                }
+                return NULL;
+        case TT_APP:
+        {
+                struct app_term *at = term_as_app_term(t);
+                struct list_data ld = get_list_data(at->right);
+                if (get_type(at->left) != T_SYMBOL ||
+                    !is_NIL(ld.terminator)) {
+                        return NULL;
+                }
+                static const struct {
+                        const char *name;
+                        enum nop op;
+                } ops[] = {
+                        { "ADD", N_ADD }, { "SUB", N_SUB },
+                        { "MUL", N_MUL }, { "DIV", N_DIV },
+                };
+                for (size_t i = 0; i < sizeof ops / sizeof *ops; i++) {
+                        if (ld.n == 2 &&
+                            is_this_symbol(at->left, ops[i].name)) {
+                                rv->op = ops[i].op;
+                                rv->a = numeric_compile(ld.vec[0], abs, self);
+                                rv->b = numeric_compile(ld.vec[1], abs, self);
+                                return rv->a != NULL && rv->b != NULL
+                                        ? rv : NULL;
+                        }
+                }
+                if (!is_this_symbol(at->left, self) ||
+                    ld.n != abs->num_params) {
+                        return NULL;
+                }
+                rv->op = N_SELF;
+                rv->n = ld.n;
+                rv->terms = alloc_object(ld.n * sizeof *rv->terms);
+                for (size_t i = 0; i < ld.n; i++) {
+                        rv->terms[i] = numeric_compile(ld.vec[i], abs, self);
+                        if (rv->terms[i] == NULL) return NULL;
+                }
+                alloc_keep_alive(ld.vec);
+                return rv;
+        }
+        case TT_GUARDED:
+        {
+                size_t n = 0;
+                struct guarded_term *gt;
+                for (gt = term_as_guarded_term(t); gt != NULL; gt = gt->next) {
+                        n++;
+                }
+                rv->op = N_COND;
+                rv->n = n;
+                rv->guards = alloc_object(n * sizeof *rv->guards);
+                rv->terms = alloc_object(n * sizeof *rv->terms);
+                n = 0;
+                for (gt = term_as_guarded_term(t); gt != NULL; gt = gt->next) {
+                        struct term *g = parse_sexp_as_term(gt->guard);
+                        if (get_term_type(g) == TT_DATA) {
+                                // data are never NIL
+                                rv->guards[n] = NULL;
+                        } else if (get_term_type(g) == TT_APP &&
+                                   is_this_symbol(term_as_app_term(g)->left,
+                                                  "EQ")) {
+                                struct list_data ld = get_list_data
+                                        (term_as_app_term(g)->right);
+                                if (ld.n != 2 || !is_NIL(ld.terminator)) {
+                                        return NULL;
+                                }
+                                struct ncode *eq = alloc_object(sizeof *eq);
+                                eq->op = N_EQ;
+                                eq->a = numeric_compile(ld.vec[0], abs, self);
+                                eq->b = numeric_compile(ld.vec[1], abs, self);
+                                if (eq->a == NULL || eq->b == NULL) {
+                                        return NULL;
+                                }
+                                rv->guards[n] = eq;
+                        } else {
+                                return NULL;
+                        }
+                        rv->terms[n] = numeric_compile(gt->term, abs, self);
+                        if (rv->terms[n] == NULL) return NULL;
+                        n++;
+                }
+                // falling off the end would give NIL
+                if (n == 0 || rv->guards[n - 1] != NULL) return NULL;
+                return rv;
+        }
+        default:
+                return NULL;
+        }
+}
+
+/* Gives the compiled lambda lc, bound to name by DEFINE or LABEL, a
+   numeric specialization if it qualifies. */
+static void specialize_numeric(struct code *lc, const char *name)
+{
+        static const char *const arith[] = {
+                "ADD", "SUB", "MUL", "DIV", "EQ"
+        };
+        for (size_t i = 0; i < 5; i++) {
+                arith_rebound[i] = get_primop_rebound_flag(arith[i]);
+        }
+        struct abs_term *abs = term_as_abs_term(parse_sexp_as_term(lc->orig));
+        if (abs->rest_param_name != NULL ||
+            abs->num_params > MAX_NUMERIC_PARAMS ||
+            arith_may_be_rebound()) {
+                return;
+        }
+        // a parameter of the same name would hide the function
+        for (size_t i = 0; i < abs->num_params; i++) {
+                if (strcasecmp(abs->params[i], name) == 0) return;
+        }
+        struct ncode *body = numeric_compile(abs->body, abs, name);
+        if (body == NULL) return;
+        struct numeric_fn *fn = alloc_object(sizeof *fn);
+        fn->name = name;
+        fn->num_params = abs->num_params;
+        fn->body = body;
+        fn->credit = NUMERIC_CREDIT;
+        lc->u.lambda.num = fn;
+}
+
+// the environment the term being compiled will run in
+static struct env *compile_env = NULL;
+// the lambda whose body is being compiled for inlining, or NULL
+static struct abs_term *inline_abs = NULL;
+static size_t inline_depth = 0;
+
+struct bound {
+        const char *name;
+        struct bound *next;
+};
+
+static bool is_bound(struct bound *b, const char *name)
+{
+        for (; b != NULL; b = b->next) {
+                if (strcasecmp(b->name, name) == 0) return true;
+        }
+        return false;
+}
+
+// the free variables of the lambda whose body is being compiled, if
+// it is converted (see run_lambda), or NULL
+static struct capture {
+        size_t n;
+        const char **names;
+} *capture = NULL;
+// the variables bound by LABEL or DO around the term being compiled,
+// within the innermost lambda body, and whether the term runs in the
+// frame of a DO (see run_loop)
+static struct bound *shadowed = NULL;
+static bool in_loop_frame = false;
+// the number of lambdas whose body is being compiled, and whether any
+// of those bodies contains a DEFINE
+static size_t lambda_depth = 0;
+static bool under_define = false;
+
+static struct code *compile(struct datum *d);
+
+// does d have at most *budget pairs and atoms?
+static bool fits_budget(struct datum *d, size_t *budget)
+{
+        while (true) {
+                if (*budget == 0) return false;
+                (*budget)--;
+                if (get_type(d) != T_PAIR) return true;
+                if (!fits_budget(get_pair_first(d), budget)) return false;
+                d = get_pair_second(d);
+        }
+}
+
+static bool mentions(struct datum *d, const char *name)
+{
+        for (; get_type(d) == T_PAIR; d = get_pair_second(d)) {
+                if (mentions(get_pair_first(d), name)) return true;
+        }
+        return is_this_symbol(d, name);
+}
+
+/* Adds to *fv (of *n names) the variables that occur free in d and
+   are not in bound.  Returns false if d contains a DEFINE, whose
+   bindings cannot be known before it is run. */
+static bool free_vars(struct datum *d, struct bound *bound,
+                      struct bound **fv, size_t *n)
+{
+        struct term *t = parse_sexp_as_term(d);
+        switch (get_term_type(t)) {
+        case TT_OTHER:
+        case TT_DATA:
+                return true;
+        case TT_VAR:
+        {
+                const char *name = term_as_var_term(t)->name;
+                if (!is_bound(bound, name) && !is_bound(*fv, name)) {
+                        struct bound *b = alloc_object(sizeof *b);
+                        b->name = name;
+                        b->next = *fv;
+                        *fv = b;
+                        (*n)++;
+                }
+                return true;
+        }
+        case TT_APP:
+        {
+                struct app_term *at = term_as_app_term(t);
+                if (!free_vars(at->left, bound, fv, n)) return false;
+                struct list_data ld = get_list_data(at->right);
+                for (size_t i = 0; i < ld.n; i++) {
+                        if (!free_vars(ld.vec[i], bound, fv, n)) return false;
+                }
+                alloc_keep_alive(ld.vec);
+                return is_NIL(ld.terminator) ||
+                        free_vars(ld.terminator, bound, fv, n);
+        }
+        case TT_ABS:
+        {
+                struct abs_term *abs = term_as_abs_term(t);
+                struct bound *b = alloc_object((abs->num_params + 1) *
+                                               sizeof *b);
+                for (size_t i = 0; i < abs->num_params; i++) {
+                        b[i].name = abs->params[i];
+                        b[i].next = bound;
+                        bound = &b[i];
+                }
+                if (abs->rest_param_name != NULL) {
+                        b[abs->num_params].name = abs->rest_param_name;
+                        b[abs->num_params].next = bound;
+                        bound = &b[abs->num_params];
+                }
+                return free_vars(abs->body, bound, fv, n);
+        }
+        case TT_MU:
+        {
+                struct mu_term *mt = term_as_mu_term(t);
+                struct bound b = { mt->var, bound };
+                return free_vars(mt->body, &b, fv, n);
+        }
+        case TT_GUARDED:
+                for (struct guarded_term *gt = term_as_guarded_term(t);
+                     gt != NULL; gt = gt->next) {
+                        if (!free_vars(gt->guard, bound, fv, n) ||
+                            !free_vars(gt->term, bound, fv, n)) {
+                                return false;
+                        }
+                }
+                return true;
+        case TT_CATCH:
+                return free_vars(term_as_catch_term(t)->body, bound, fv, n);
+        case TT_LOOP:
+        {
+                struct loop_term *lt = term_as_loop_term(t);
+                for (size_t i = 0; i < lt->num_vars; i++) {
+                        if (!free_vars(lt->inits[i], bound, fv, n)) {
+                                return false;
+                        }
+                }
+                struct bound *b = alloc_object(lt->num_vars * sizeof *b);
+                for (size_t i = 0; i < lt->num_vars; i++) {
+                        b[i].name = lt->vars[i];
+                        b[i].next = bound;
+                        bound = &b[i];
+                }
+                for (size_t i = 0; i < lt->num_vars; i++) {
+                        if (lt->steps[i] != NULL &&
+                            !free_vars(lt->steps[i], bound, fv, n)) {
+                                return false;
+                        }
+                }
+                return free_vars(lt->test, bound, fv, n) &&
+                        free_vars(lt->result, bound, fv, n) &&
+                        (lt->body == NULL ||
+                         free_vars(lt->body, bound, fv, n));
+        }
+        case TT_DELAY:
+                return free_vars(term_as_delay_term(t)->lambda, bound, fv, n);
+        case TT_DEFINE:
+                return false;
+        }
+        NOTREACHED;
+}
+
+/* If guard has the form described above run_cond_table, stores its
+   key (or NULL for a quoted one) in *key and returns its variable,
+   else returns NULL. */
+static struct datum *cond_table_guard(struct datum *guard, struct datum **key)
+{
+        struct term *t = parse_sexp_as_term(guard);
+        if (get_term_type(t) != TT_APP) return NULL;
+        struct app_term *at = term_as_app_term(t);
+        if (!is_this_symbol(at->left, "EQ")) return NULL;
+        struct list_data ld = get_list_data(at->right);
+        if (ld.n != 2 || !is_NIL(ld.terminator)) return NULL;
+        for (size_t i = 0; i < 2; i++) {
+                struct datum *var = ld.vec[i];
+                struct term *kt = parse_sexp_as_term(ld.vec[1 - i]);
+                if (get_type(var) != T_SYMBOL ||
+                    get_term_type(kt) != TT_DATA) {
+                        continue;
+                }
+                struct datum *k = get_original_sexp(kt);
+                if (is_fixnum(k)) {
+                        *key = k;
+                        return var;
+                }
+                if (get_type(k) == T_PAIR) {
+                        *key = NULL;
+                        return var;
+                }
+        }
+        return NULL;
+}
+
+/* Makes the compiled COND rv dispatch through a table, if it has the
+   form described above run_cond_table. */
+static void try_cond_table(struct code *rv)
+{
+        struct datum *var = NULL;
+        size_t prefix = 0;
+        struct datum **keys = alloc_object(rv->u.cond.n * sizeof *keys);
+        for (; prefix < rv->u.cond.n; prefix++) {
+                struct datum *v = cond_table_guard(
+                        rv->u.cond.guards[prefix]->orig, &keys[prefix]);
+                if (v == NULL || (var != NULL &&
+                                  strcasecmp(get_symbol_name(v),
+                                             get_symbol_name(var)) != 0)) {
+                        break;
+                }
+                if (var == NULL) var = v;
+        }
+        if (prefix < COND_TABLE_MIN) return;
+        size_t mask = 1;
+        while (mask < 2 * prefix) mask <<= 1;
+        struct cond_slot *table = alloc_atomic(mask * sizeof *table);
+        mask--;
+        for (size_t h = 0; h <= mask; h++) table[h].clause = SIZE_MAX;
+        for (size_t i = 0; i < prefix; i++) {
+                if (keys[i] == NULL) continue;
+                int64_t key = get_fixnum_value(keys[i]);
+                size_t h = cond_hash(key, mask);
+                while (table[h].clause != SIZE_MAX && table[h].key != key) {
+                        h = (h + 1) & mask;
+                }
+                // an earlier clause with the same key wins
+                if (table[h].clause != SIZE_MAX) continue;
+                table[h].key = key;
+                table[h].clause = i;
+        }
+        rv->u.cond.var = compile(var);
+        rv->u.cond.prefix = prefix;
+        rv->u.cond.keys = keys;
+        rv->u.cond.table = table;
+        rv->u.cond.mask = mask;
+        rv->u.cond.rebound = get_primop_rebound_flag("EQ");
+        rv->run = run_cond_table;
+}
+
+/* Makes the compiled call rv inline the lambda it calls, if that is
+   possible (see run_inline). */
+static void try_inline(struct code *rv, struct app_term *at)
+{
+        if (rv->u.app.rest != NULL || inline_depth >= MAX_INLINE_DEPTH) {
+                return;
+        }
+        struct term *ft = parse_sexp_as_term(at->left);
+        struct datum *lambda;
+        struct env *env = NULL;
+        const char *name = NULL;
+        struct datum *fun = NULL;
+        if (get_term_type(ft) == TT_ABS) {
+                // the body runs in a frame over the caller's
+                // environment, which must not itself be a frame
+                if (inline_abs != NULL || in_loop_frame) return;
+                lambda = at->left;
+        } else if (get_term_type(ft) == TT_VAR && compile_env != NULL) {
+                name = term_as_var_term(ft)->name;
+                // a parameter of an inlined lambda or a DO variable is
+                // bound in a frame, which env_bind never sees
+                if (is_bound(shadowed, name)) return;
+                for (size_t i = 0;
+                     inline_abs != NULL && i < inline_abs->num_params;
+                     i++) {
+                        if (strcasecmp(inline_abs->params[i], name) == 0) {
+                                return;
+                        }
+                }
+                if (!env_lookup(compile_env, name, &fun) ||
+                    get_type(fun) != T_CLOSURE) {
+                        return;
+                }
+                lambda = get_closure_fun(fun);
+                env = get_closure_env(fun);
+        } else {
+                return;
+        }
+        struct abs_term *abs = term_as_abs_term(parse_sexp_as_term(lambda));
+        size_t budget = INLINE_BUDGET;
+        if (!abs->frame_args || abs->num_params != rv->u.app.argc ||
+            abs->num_params > MAX_INLINE_PARAMS ||
+            !fits_budget(abs->body, &budget) ||
+            (name != NULL && mentions(abs->body, name))) {
+                return;
+        }
+        struct abs_term *saved = inline_abs;
+        struct capture *saved_capture = capture;
+        struct bound *saved_shadowed = shadowed;
+        bool saved_in_loop_frame = in_loop_frame;
+        inline_abs = abs;
+        inline_depth++;
+        capture = NULL;
+        shadowed = NULL;
+        in_loop_frame = false;
+        rv->u.app.inline_body = compile(abs->body);
+        inline_abs = saved;
+        inline_depth--;
+        capture = saved_capture;
+        shadowed = saved_shadowed;
+        in_loop_frame = saved_in_loop_frame;
+        rv->u.app.params = abs->params;
+        rv->u.app.inline_env = env;
+        rv->u.app.changed = name != NULL ? env_watch(name, fun) : NULL;
+        rv->run = run_inline;
+}
+
+static struct code *compile(struct datum *d)
+{
+        struct term *t = parse_sexp_as_term(d);
+        switch (get_term_type(t)) {
+        case TT_OTHER:
+                return new_code(run_other, d);
+        case TT_DATA:
+                return new_code(run_data, get_original_sexp(t));
+        case TT_VAR:
+        {
+                const char *name = term_as_var_term(t)->name;
+                if (is_bound(shadowed, name)) {
+                        struct code *rv = new_code(run_var, d);
+                        rv->u.var = name;
+                        return rv;
+                }
+                // later parameters shadow earlier ones
+                for (size_t i = inline_abs != NULL ? inline_abs->num_params : 0;
+                     i-- > 0; ) {
+                        if (strcasecmp(inline_abs->params[i], name) == 0) {
+                                struct code *rv = new_code(run_slot, d);
+                                rv->u.slot = i;
+                                return rv;
+                        }
+                }
+                for (size_t i = 0; capture != NULL && i < capture->n; i++) {
+                        if (strcasecmp(capture->names[i], name) == 0) {
+                                struct code *rv = new_code(run_captured, d);
+                                rv->u.captured.var = name;
+                                rv->u.captured.names = capture->names;
+                                rv->u.captured.index = i;
+                                return rv;
+                        }
+                }
+                struct code *rv = new_code(run_var, d);
+                rv->u.var = name;
+                return rv;
+        }
+        case TT_APP:
+        {
+                struct app_term *at = term_as_app_term(t);
+                struct list_data ld = get_list_data(at->right);
+                struct code *rv = new_code(run_app, d);
+                rv->u.app.fun = compile(at->left);
+                rv->u.app.argc = ld.n;
+                rv->u.app.argv = ld.n > 0
+                        ? alloc_object(ld.n * sizeof *rv->u.app.argv)
+                        : NULL;
+                for (size_t i = 0; i < ld.n; i++) {
+                        rv->u.app.argv[i] = compile(ld.vec[i]);
+                }
+                alloc_keep_alive(ld.vec);
+                rv->u.app.rest = is_NIL(ld.terminator)
+                        ? NULL
+                        : compile(ld.terminator);
+                if (get_type(at->left) == T_SYMBOL && rv->u.app.rest == NULL) {
+                        const char *name = get_symbol_name(at->left);
+                        fast_fun fast = get_primop_fast(name, ld.n);
+                        if (fast != NULL) {
+                                rv->run = run_app_prim;
+                                rv->u.app.prim = get_primop(name);
+                                rv->u.app.fast = fast;
+                                rv->u.app.rebound =
+                                        get_primop_rebound_flag(name);
+                                return rv;
+                        }
+                }
+                try_inline(rv, at);
+                return rv;
+        }
+        case TT_ABS:
+        {
+                struct abs_term *abs = term_as_abs_term(t);
+                struct code *rv = new_code(run_lambda, d);
+                rv->u.lambda.num_params = abs->num_params;
+                rv->u.lambda.params = abs->params;
+                rv->u.lambda.rest_param_name = abs->rest_param_name;
+                struct bound *fv = NULL;
+                size_t n = 0;
+                bool definite = free_vars(d, NULL, &fv, &n);
+                struct capture c = { n, NULL };
+                if (definite && lambda_depth > 0 && !under_define) {
+                        c.names = alloc_object((n > 0 ? n : 1) *
+                                               sizeof *c.names);
+                        for (size_t i = n; i-- > 0; fv = fv->next) {
+                                c.names[i] = fv->name;
+                        }
+                        rv->u.lambda.num_captured = n;
+                        rv->u.lambda.captured = c.names;
+                }
+                struct capture *saved_capture = capture;
+                struct bound *saved_shadowed = shadowed;
+                bool saved_in_loop_frame = in_loop_frame;
+                bool saved_under_define = under_define;
+                capture = c.names != NULL ? &c : NULL;
+                shadowed = NULL;
+                in_loop_frame = false;
+                under_define = under_define || !definite;
+                lambda_depth++;
+                rv->u.lambda.body = compile(abs->body);
+                capture = saved_capture;
+                shadowed = saved_shadowed;
+                in_loop_frame = saved_in_loop_frame;
+                under_define = saved_under_define;
+                lambda_depth--;
+                return rv;
+        }
+        case TT_MU:
+        {
+                struct mu_term *mt = term_as_mu_term(t);
+                struct code *rv = new_code(run_mu, d);
+                rv->u.mu.var = mt->var;
+                struct bound b = { mt->var, shadowed };
+                shadowed = &b;
+                rv->u.mu.body = compile(mt->body);
+                shadowed = b.next;
+                if (rv->u.mu.body->run == run_lambda) {
+                        specialize_numeric(rv->u.mu.body, mt->var);
+                }
+                return rv;
+        }
+        case TT_GUARDED:
+        {
+                struct code *rv = new_code(run_cond, d);
+                size_t n = 0;
+                for (struct guarded_term *gt = term_as_guarded_term(t);
+                     gt != NULL; gt = gt->next) {
+                        n++;
+                }
+                rv->u.cond.n = n;
+                rv->u.cond.guards = alloc_object(n * sizeof *rv->u.cond.guards);
+                rv->u.cond.terms = alloc_object(n * sizeof *rv->u.cond.terms);
+                n = 0;
+                for (struct guarded_term *gt = term_as_guarded_term(t);
+                     gt != NULL; gt = gt->next) {
+                        rv->u.cond.guards[n] = compile(gt->guard);
+                        rv->u.cond.terms[n] = compile(gt->term);
+                        n++;
+                }
+                try_cond_table(rv);
+                return rv;
+        }
+        case TT_DELAY:
+        {
+                struct code *rv = new_code(run_delay, d);
+                rv->u.body = compile(term_as_delay_term(t)->lambda);
+                return rv;
+        }
+        case TT_LOOP:
+        {
+                struct loop_term *lt = term_as_loop_term(t);
+                size_t n = lt->num_vars;
+                struct code *rv = new_code(run_loop, d);
+                rv->u.loop.n = n;
+                rv->u.loop.vars = lt->vars;
+                rv->u.loop.inits = alloc_object(n * sizeof *rv->u.loop.inits);
+                rv->u.loop.steps = alloc_object(n * sizeof *rv->u.loop.steps);
+                rv->u.loop.frame = lt->frame_vars;
+                for (size_t i = 0; i < n; i++) {
+                        rv->u.loop.inits[i] = compile(lt->inits[i]);
+                }
+                struct bound *b = alloc_object(n * sizeof *b);
+                struct bound *saved_shadowed = shadowed;
+                bool saved_in_loop_frame = in_loop_frame;
+                for (size_t i = 0; i < n; i++) {
+                        b[i].name = lt->vars[i];
+                        b[i].next = shadowed;
+                        shadowed = &b[i];
+                }
+                in_loop_frame = in_loop_frame || lt->frame_vars;
+                for (size_t i = 0; i < n; i++) {
+                        if (lt->steps[i] != NULL) {
+                                rv->u.loop.steps[i] = compile(lt->steps[i]);
+                        }
+                }
+                rv->u.loop.test = compile(lt->test);
+                rv->u.loop.result = compile(lt->result);
+                rv->u.loop.body = lt->body != NULL ? compile(lt->body) : NULL;
+                shadowed = saved_shadowed;
+                in_loop_frame = saved_in_loop_frame;
+                return rv;
+        }
+        case TT_CATCH:
+        {
+                struct code *rv = new_code(run_catch, d);
+                rv->u.body = compile(term_as_catch_term(t)->body);
+                return rv;
+        }
+        case TT_DEFINE:
+        {
+                struct code *rv = new_code(run_define, d);
+                size_t n = 0;
+                for (struct define_term *dt = term_as_define_term(t);
+                     dt != NULL; dt = dt->next) {
+                        n++;
+                }
+                rv->u.define.n = n;
+                rv->u.define.names = alloc_object(n * sizeof *rv->u.define.names);
+                rv->u.define.bindings =
+                        alloc_object(n * sizeof *rv->u.define.bindings);
+                n = 0;
+                for (struct define_term *dt = term_as_define_term(t);
+                     dt != NULL; dt = dt->next) {
+                        rv->u.define.names[n] = dt->name;
+                        rv->u.define.bindings[n] = compile(dt->binding);
+                        if (rv->u.define.bindings[n]->run == run_lambda) {
+                                specialize_numeric(rv->u.define.bindings[n],
+                                                   dt->name);
+                        }
+                        n++;
+                }
+                return rv;
+        }
+        }
+        NOTREACHED;
+}
+
+struct datum *code_eval(struct datum *d, struct env *env)
+{
+        struct env *saved = compile_env;
+        compile_env = env;
+        struct code *c = compile(d);
+        compile_env = saved;
+        return run(c, env);
+}
@@ -0,0 +1,63 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef GUARD_COMPILE_H
+#define GUARD_COMPILE_H
+
+#include "data.h"
+#include "env.h"
+
+/* An alternative to the tree walker eval_term in eval.c.  A term is
+   compiled once into a tree of struct code nodes, each holding a
+   pointer to a C function specialized for the node's shape (a
+   constant, a variable, a call of a primitive with one or two
+   arguments, a COND, and so on), so that running it needs no
+   dispatch on the term type.  Closures created by compiled code
+   carry their compiled body (see get_closure_code in data.h).
+   Functions defined to compute only on numbers are also compiled to
+   run on unboxed numbers (see numeric_call in compile.c), and
+   closures made inside functions keep only the values of their free
+   variables (see run_lambda in compile.c), and a COND comparing a
+   variable against constant keys dispatches through a hash table
+   (see run_cond_table in compile.c).
+
+   The results, and the errors raised, are the same as those of
+   eval_term, and so are the backtraces, except after long chains of
+   tail calls, of which eval_term keeps only the first and the last
+   (see eval_term in eval.c).
+ */
+
+/* Compiles the term represented by the S-expression and runs it in
+   the environment given. */
+struct datum *code_eval(struct datum *, struct env *);
+
+/* Applies a closure that has compiled code to a list of evaluated
+   arguments. */
+struct datum *code_apply(struct datum *fun, struct datum *arg);
+
+#endif /* GUARD_COMPILE_H */
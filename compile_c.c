@@ -0,0 +1,881 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+#include "alloc.h"
+#include "ast.h"
+#include "bignum.h"
+#include "compile_c.h"
+#include "error.h"
+#include "primops.h"
+#include "strvec.h"
+
+/* The generated file has three static arrays: K holds the constants
+   (quoted data, and source code handed to the interpreter), P the
+   primitives called directly, and G one primitive datum for each
+   compiled function.  Compiled function number i is implemented by
+   Fi, which takes its parameters as C arguments, and by Ei, the
+   prim_fun entry point that unpacks an argument list for Fi.
+
+   Evaluation mirrors eval_term, and errors are raised with
+   raise_error as there.  Calls of primitives and of the functions
+   defined in the file go to them directly only while their names
+   keep those bindings: R holds the rebound flags of the primitives
+   (get_primop_rebound_flag in primops.h) and W watches on the
+   definitions (env_watch in env.h).  Once a name has been bound to
+   something else, for example by a later DEFINE, its calls look the
+   name up like the interpreter does.
+ */
+
+// growable text buffer
+struct cbuf {
+        char *s;
+        size_t len;
+        size_t max;
+};
+
+FORMAT(static void cbuf_printf(struct cbuf *, const char *fmt, ...),
+       printf, 2, 3);
+static void cbuf_printf(struct cbuf *b, const char *fmt, ...)
+{
+        va_list ap, ap1;
+        va_start(ap, fmt);
+        va_copy(ap1, ap);
+        int n = vsnprintf(NULL, 0, fmt, ap);
+        if (n < 0) NOTREACHED;
+        if (b->len + n + 1 > b->max) {
+                b->max = 2 * (b->len + n + 1);
+                b->s = alloc_realloc(b->s, b->max);
+        }
+        vsnprintf(b->s + b->len, n + 1, fmt, ap1);
+        b->len += n;
+        va_end(ap1);
+        va_end(ap);
+}
+
+// appends str as a C string literal
+static void cbuf_cstring(struct cbuf *b, const char *str)
+{
+        cbuf_printf(b, "\"");
+        for (const char *p = str; *p != '\0'; p++) {
+                unsigned char c = *p;
+                if (c == '"' || c == '\\' || c == '?') {
+                        cbuf_printf(b, "\\%c", c);
+                } else if (isprint(c)) {
+                        cbuf_printf(b, "%c", c);
+                } else {
+                        cbuf_printf(b, "\\%03o", c);
+                }
+        }
+        cbuf_printf(b, "\"");
+}
+
+struct cfun {
+        size_t id;
+        const char *name;        // for the C identifier; may be NULL
+        struct abs_term *abs;
+        const char *self;        // bound to the function itself, or NULL
+        struct cbuf body;
+        int depth;               // indentation of the body
+        size_t ntemps;
+        size_t nlabels;
+        bool uses_env;           // needs e for interpreter fallback
+        bool tail_calls_self;    // needs the label top
+        struct cfun *next;
+};
+
+struct cdef {
+        const char *name;
+        struct datum *binding;
+        struct cfun *fun;        // NULL if evaluated by the interpreter
+        size_t konst;            // binding as a constant, if fun is NULL
+        struct cdef *next;
+};
+
+static struct cbuf consts;
+static size_t nconsts = 0;
+static struct str_vec *prims = NULL;
+static struct cfun *funs = NULL;
+static struct cfun *last_fun = NULL;
+static size_t nfuns = 0;
+static struct cdef *defs = NULL;
+static struct cdef *last_def = NULL;
+// whether the generated code calls global_ref or a primitive through
+// P, which are only written out then, so that the file compiles
+// without warnings
+static bool uses_global_ref = false;
+static bool uses_prim_table = false;
+
+FORMAT(static void emit(struct cfun *, const char *fmt, ...), printf, 2, 3);
+static void emit(struct cfun *fn, const char *fmt, ...)
+{
+        cbuf_printf(&fn->body, "%*s", 8 * fn->depth, "");
+        va_list ap;
+        va_start(ap, fmt);
+        char buf[512];
+        int n = vsnprintf(buf, sizeof buf, fmt, ap);
+        if (n < 0 || (size_t)n >= sizeof buf) NOTREACHED;
+        va_end(ap);
+        cbuf_printf(&fn->body, "%s\n", buf);
+}
+
+/* Emits code that builds the datum into K and returns its index. */
+static size_t add_const(struct datum *d)
+{
+        size_t k = nconsts++;
+        switch (get_type(d)) {
+        case T_PAIR:
+        {
+                struct list_data ld = get_list_data(d);
+                size_t *elems = alloc_atomic(ld.n * sizeof *elems);
+                for (size_t i = 0; i < ld.n; i++) {
+                        elems[i] = add_const(ld.vec[i]);
+                }
+                alloc_keep_alive(ld.vec);
+                size_t term = add_const(ld.terminator);
+                cbuf_printf(&consts, "        K[%zu] = K[%zu];\n", k, term);
+                for (size_t i = ld.n; i-- > 0; ) {
+                        cbuf_printf(&consts,
+                                    "        K[%zu] = make_pair(K[%zu], K[%zu]);\n",
+                                    k, elems[i], k);
+                }
+                return k;
+        }
+        case T_SYMBOL:
+                if (is_NIL(d)) {
+                        cbuf_printf(&consts, "        K[%zu] = make_NIL();\n", k);
+                } else {
+                        cbuf_printf(&consts,
+                                    "        K[%zu] = make_symbolic_atom_cstr(", k);
+                        cbuf_cstring(&consts, get_symbol_name(d));
+                        cbuf_printf(&consts, ");\n");
+                }
+                return k;
+        case T_INTEGER:
+                if (is_fixnum(d)) {
+                        cbuf_printf(&consts,
+                                    "        K[%zu] = make_integer_atom(INT64_C(%"
+                                    PRId64 "));\n", k, get_fixnum_value(d));
+                } else {
+                        const char *s = bignum_to_decimal(get_bignum_value(d));
+                        bool neg = s[0] == '-';
+                        if (neg) s++;
+                        cbuf_printf(&consts, "        K[%zu] = make_bignum_atom(", k);
+                        if (neg) {
+                                cbuf_printf(&consts,
+                                            "bignum_sub(bignum_from_int64(0), ");
+                        }
+                        cbuf_printf(&consts, "bignum_from_decimal(\"%s\", %zu)",
+                                    s, strlen(s));
+                        cbuf_printf(&consts, neg ? "));\n" : ");\n");
+                }
+                return k;
+        case T_NUMBER:
+                cbuf_printf(&consts, "        K[%zu] = make_numeric_atom(%.17g);\n",
+                            k, get_numeric_value(d));
+                return k;
+        case T_VECTOR:
+        {
+                size_t l = add_const(vector_to_list(d));
+                cbuf_printf(&consts,
+                            "        K[%zu] = make_vector_from_list(K[%zu]);\n",
+                            k, l);
+                return k;
+        }
+        case T_ERROR: case T_PRIMITIVE: case T_CLOSURE: case T_HASH:
+        case T_F64VEC: case T_PROMISE:
+                // these do not occur in source code
+                NOTREACHED;
+        }
+        NOTREACHED;
+}
+
+static size_t prim_index(const char *name)
+{
+        size_t n = str_vec_len(prims);
+        const char **v = str_vec_to_array(prims);
+        for (size_t i = 0; i < n; i++) {
+                if (strcasecmp(v[i], name) == 0) return i;
+        }
+        str_vec_append(prims, name);
+        return n;
+}
+
+// does the symbol occur anywhere in d (including quoted data)?
+static bool mentions(struct datum *d, const char *name)
+{
+        while (get_type(d) == T_PAIR) {
+                if (mentions(get_pair_first(d), name)) return true;
+                d = get_pair_second(d);
+        }
+        return is_this_symbol(d, name);
+}
+
+// does a DEFINE form occur anywhere in d?
+static bool contains_define(struct datum *d)
+{
+        if (get_type(d) != T_PAIR) return false;
+        if (is_this_symbol(get_pair_first(d), "DEFINE")) return true;
+        while (get_type(d) == T_PAIR) {
+                if (contains_define(get_pair_first(d))) return true;
+                d = get_pair_second(d);
+        }
+        return false;
+}
+
+// can this lambda be compiled into a C function, given the local
+// variables of the function it appears in (which it must not see)?
+static bool compilable(struct datum *lambda, struct cfun *outer)
+{
+        struct term *t = parse_sexp_as_term(lambda);
+        if (get_term_type(t) != TT_ABS) return false;
+        if (contains_define(lambda)) return false;
+        if (outer == NULL) return true;
+        struct abs_term *abs = outer->abs;
+        for (size_t i = 0; i < abs->num_params; i++) {
+                if (mentions(lambda, abs->params[i])) return false;
+        }
+        if (abs->rest_param_name != NULL &&
+            mentions(lambda, abs->rest_param_name)) return false;
+        if (outer->self != NULL && mentions(lambda, outer->self)) return false;
+        return true;
+}
+
+static struct cfun *new_cfun(const char *name, struct datum *lambda,
+                             const char *self)
+{
+        struct cfun *fn = alloc_object(sizeof *fn);
+        fn->id = nfuns++;
+        fn->name = name;
+        fn->abs = term_as_abs_term(parse_sexp_as_term(lambda));
+        fn->self = self;
+        fn->depth = 1;
+        fn->next = NULL;
+        if (funs == NULL) {
+                funs = fn;
+        } else {
+                last_fun->next = fn;
+        }
+        last_fun = fn;
+        return fn;
+}
+
+enum ref_kind { REF_PARAM, REF_REST, REF_FUN, REF_PRIM, REF_GLOBAL };
+
+struct ref {
+        enum ref_kind kind;
+        size_t index;            // parameter number
+        struct cfun *fun;        // for REF_FUN
+        bool global;             // REF_FUN bound by a DEFINE in the file
+};
+
+// resolves a variable the way the environment of a call of fn would
+static struct ref resolve(struct cfun *fn, const char *name)
+{
+        struct abs_term *abs = fn->abs;
+        if (abs->rest_param_name != NULL &&
+            strcasecmp(abs->rest_param_name, name) == 0) {
+                return (struct ref) { .kind = REF_REST };
+        }
+        // later parameters shadow earlier ones of the same name
+        for (size_t i = abs->num_params; i-- > 0; ) {
+                if (strcasecmp(abs->params[i], name) == 0) {
+                        return (struct ref) { .kind = REF_PARAM, .index = i };
+                }
+        }
+        if (fn->self != NULL && strcasecmp(fn->self, name) == 0) {
+                return (struct ref) { .kind = REF_FUN, .fun = fn };
+        }
+        struct cdef *found = NULL;
+        for (struct cdef *def = defs; def != NULL; def = def->next) {
+                if (strcasecmp(def->name, name) == 0) found = def;
+        }
+        if (found != NULL) {
+                if (found->fun != NULL) {
+                        return (struct ref) { .kind = REF_FUN,
+                                        .fun = found->fun, .global = true };
+                }
+                return (struct ref) { .kind = REF_GLOBAL };
+        }
+        if (get_primop(name) != NULL) {
+                return (struct ref) { .kind = REF_PRIM };
+        }
+        return (struct ref) { .kind = REF_GLOBAL };
+}
+
+static size_t compile_expr(struct cfun *fn, struct datum *d);
+
+static size_t new_temp(struct cfun *fn)
+{
+        return fn->ntemps++;
+}
+
+// emits code setting e to the environment a call of fn would have
+static void emit_local_env(struct cfun *fn)
+{
+        fn->uses_env = true;
+        emit(fn, "e = env_clone(genv);");
+        if (fn->self != NULL) {
+                cbuf_printf(&fn->body, "%*senv_bind(e, ", 8 * fn->depth, "");
+                cbuf_cstring(&fn->body, fn->self);
+                cbuf_printf(&fn->body, ", G[%zu]);\n", fn->id);
+        }
+        for (size_t i = 0; i < fn->abs->num_params; i++) {
+                cbuf_printf(&fn->body, "%*senv_bind(e, ", 8 * fn->depth, "");
+                cbuf_cstring(&fn->body, fn->abs->params[i]);
+                cbuf_printf(&fn->body, ", a%zu);\n", i);
+        }
+        if (fn->abs->rest_param_name != NULL) {
+                cbuf_printf(&fn->body, "%*senv_bind(e, ", 8 * fn->depth, "");
+                cbuf_cstring(&fn->body, fn->abs->rest_param_name);
+                cbuf_printf(&fn->body, ", rest);\n");
+        }
+}
+
+static size_t compile_interpreted(struct cfun *fn, struct datum *d)
+{
+        size_t k = add_const(d);
+        size_t r = new_temp(fn);
+        emit_local_env(fn);
+        emit(fn, "t%zu = eval_in_env(K[%zu], e);", r, k);
+        return r;
+}
+
+// evaluates the (proper) argument list of an application into
+// temporaries
+static void compile_args(struct cfun *fn, struct datum *args, size_t *temps)
+{
+        for (size_t n = 0; get_type(args) == T_PAIR;
+             args = get_pair_second(args)) {
+                temps[n++] = compile_expr(fn, get_pair_first(args));
+        }
+}
+
+// emits code building a list of the given temporaries into temp r
+static void emit_list(struct cfun *fn, size_t r, size_t *temps, size_t n)
+{
+        emit(fn, "t%zu = make_NIL();", r);
+        for (size_t i = n; i-- > 0; ) {
+                emit(fn, "t%zu = make_pair(t%zu, t%zu);", r, temps[i], r);
+        }
+}
+
+// emits code calling the function now bound to the global name op,
+// with the arguments in the temporaries a, into r
+static void emit_global_call(struct cfun *fn, struct datum *op,
+                             size_t *a, size_t n, size_t r)
+{
+        emit_list(fn, r, a, n);
+        emit(fn, "t%zu = eval_apply(global_ref(K[%zu]), t%zu);",
+             r, add_const(op), r);
+        uses_global_ref = true;
+}
+
+static void compile_prim_fast(struct cfun *fn, const char *name,
+                              size_t *a, size_t n, size_t r)
+{
+        static const char *const arith[] = { "ADD", "SUB", "MUL", "DIV" };
+        for (size_t i = 0; n == 2 && i < sizeof arith / sizeof *arith; i++) {
+                if (strcasecmp(name, arith[i]) != 0) continue;
+                emit(fn, "if (is_number(t%zu) && is_number(t%zu)) {", a[0], a[1]);
+                emit(fn, "        t%zu = number_%c%c%c(t%zu, t%zu);", r,
+                     tolower(arith[i][0]), tolower(arith[i][1]),
+                     tolower(arith[i][2]), a[0], a[1]);
+                emit(fn, "} else {");
+                fn->depth++;
+                emit_list(fn, r, a, n);
+                emit(fn, "raise_error(t%zu, \"%s: type error\");",
+                     r, arith[i]);
+                fn->depth--;
+                emit(fn, "}");
+                return;
+        }
+        if (n == 1 && (strcasecmp(name, "CAR") == 0 ||
+                       strcasecmp(name, "CDR") == 0)) {
+                bool car = strcasecmp(name, "CAR") == 0;
+                emit(fn, "if (get_type(t%zu) == T_PAIR) {", a[0]);
+                emit(fn, "        t%zu = get_pair_%s(t%zu);", r,
+                     car ? "first" : "second", a[0]);
+                emit(fn, "} else {");
+                fn->depth++;
+                emit_list(fn, r, a, n);
+                emit(fn, "raise_error(t%zu, \"%s: not a pair\");",
+                     r, car ? "CAR" : "CDR");
+                fn->depth--;
+                emit(fn, "}");
+                return;
+        }
+        if (n == 2 && strcasecmp(name, "CONS") == 0) {
+                emit(fn, "t%zu = make_pair(t%zu, t%zu);", r, a[0], a[1]);
+                return;
+        }
+        emit_list(fn, r, a, n);
+        emit(fn, "t%zu = P[%zu](t%zu);", r, prim_index(name), r);
+        uses_prim_table = true;
+}
+
+static size_t compile_prim_call(struct cfun *fn, struct datum *op,
+                                size_t *a, size_t n, size_t r)
+{
+        const char *name = get_symbol_name(op);
+        emit(fn, "if (!*R[%zu]) {", prim_index(name));
+        fn->depth++;
+        compile_prim_fast(fn, name, a, n, r);
+        fn->depth--;
+        emit(fn, "} else {");
+        fn->depth++;
+        emit_global_call(fn, op, a, n, r);
+        fn->depth--;
+        emit(fn, "}");
+        return r;
+}
+
+static size_t compile_app(struct cfun *fn, struct datum *d)
+{
+        struct app_term *at = term_as_app_term(parse_sexp_as_term(d));
+        size_t r = new_temp(fn);
+        size_t nargs = 0;
+        struct datum *it;
+        for (it = at->right; get_type(it) == T_PAIR; it = get_pair_second(it)) {
+                nargs++;
+        }
+        size_t *a = alloc_atomic((nargs + 1) * sizeof *a);
+
+        if (get_type(at->left) == T_SYMBOL && is_NIL(it)) {
+                struct ref ref = resolve(fn, get_symbol_name(at->left));
+                if (ref.kind == REF_PRIM) {
+                        compile_args(fn, at->right, a);
+                        compile_prim_call(fn, at->left, a, nargs, r);
+                        return r;
+                }
+                if (ref.kind == REF_FUN &&
+                    ref.fun->abs->rest_param_name == NULL &&
+                    ref.fun->abs->num_params == nargs) {
+                        compile_args(fn, at->right, a);
+                        if (ref.global) {
+                                emit(fn, "if (!*W[%zu]) {", ref.fun->id);
+                                fn->depth++;
+                        }
+                        cbuf_printf(&fn->body, "%*st%zu = F%zu(",
+                                    8 * fn->depth, "", r, ref.fun->id);
+                        for (size_t i = 0; i < nargs; i++) {
+                                cbuf_printf(&fn->body, "%st%zu",
+                                            i > 0 ? ", " : "", a[i]);
+                        }
+                        cbuf_printf(&fn->body, ");\n");
+                        if (ref.global) {
+                                fn->depth--;
+                                emit(fn, "} else {");
+                                fn->depth++;
+                                emit_global_call(fn, at->left, a, nargs, r);
+                                fn->depth--;
+                                emit(fn, "}");
+                        }
+                        return r;
+                }
+        }
+
+        // generic application
+        size_t f = compile_expr(fn, at->left);
+        size_t n = 0;
+        for (it = at->right; get_type(it) == T_PAIR; it = get_pair_second(it)) {
+                a[n++] = compile_expr(fn, get_pair_first(it));
+        }
+        size_t args = new_temp(fn);
+        if (!is_NIL(it)) {
+                // improper argument list: the terminator is evaluated too
+                emit(fn, "t%zu = t%zu;", args, compile_expr(fn, it));
+        } else {
+                emit(fn, "t%zu = make_NIL();", args);
+        }
+        for (size_t i = n; i-- > 0; ) {
+                emit(fn, "t%zu = make_pair(t%zu, t%zu);", args, a[i], args);
+        }
+        emit(fn, "t%zu = eval_apply(t%zu, t%zu);", r, f, args);
+        return r;
+}
+
+static size_t compile_fun_value(struct cfun *fn, struct datum *lambda,
+                                const char *self)
+{
+        struct cfun *g = new_cfun(self, lambda, self);
+        size_t r = new_temp(fn);
+        emit(fn, "t%zu = G[%zu];", r, g->id);
+        return r;
+}
+
+// emits code computing the value of d and returns its temporary
+static size_t compile_expr(struct cfun *fn, struct datum *d)
+{
+        struct term *t = parse_sexp_as_term(d);
+        size_t r;
+        switch (get_term_type(t)) {
+        case TT_OTHER:
+                r = new_temp(fn);
+                emit(fn, "raise_error(K[%zu], \"ERROR: Cannot evaluate\");",
+                     add_const(d));
+                emit(fn, "t%zu = make_NIL();", r);
+                return r;
+        case TT_DATA:
+                r = new_temp(fn);
+                emit(fn, "t%zu = K[%zu];", r, add_const(get_original_sexp(t)));
+                return r;
+        case TT_VAR:
+        {
+                const char *name = term_as_var_term(t)->name;
+                struct ref ref = resolve(fn, name);
+                r = new_temp(fn);
+                switch (ref.kind) {
+                case REF_PARAM:
+                        emit(fn, "t%zu = a%zu;", r, ref.index);
+                        break;
+                case REF_REST:
+                        emit(fn, "t%zu = rest;", r);
+                        break;
+                case REF_FUN:
+                        if (ref.global) {
+                                emit(fn, "t%zu = *W[%zu] ? global_ref(K[%zu])"
+                                     " : G[%zu];", r, ref.fun->id,
+                                     add_const(d), ref.fun->id);
+                                uses_global_ref = true;
+                        } else {
+                                emit(fn, "t%zu = G[%zu];", r, ref.fun->id);
+                        }
+                        break;
+                case REF_PRIM: case REF_GLOBAL:
+                        emit(fn, "t%zu = global_ref(K[%zu]);", r, add_const(d));
+                        uses_global_ref = true;
+                        break;
+                }
+                return r;
+        }
+        case TT_APP:
+                return compile_app(fn, d);
+        case TT_GUARDED:
+        {
+                r = new_temp(fn);
+                size_t label = fn->nlabels++;
+                for (struct guarded_term *gt = term_as_guarded_term(t);
+                     gt != NULL; gt = gt->next) {
+                        size_t g = compile_expr(fn, gt->guard);
+                        emit(fn, "if (!is_NIL(t%zu)) {", g);
+                        fn->depth++;
+                        size_t v = compile_expr(fn, gt->term);
+                        emit(fn, "t%zu = t%zu;", r, v);
+                        emit(fn, "goto L%zu;", label);
+                        fn->depth--;
+                        emit(fn, "}");
+                }
+                emit(fn, "t%zu = make_NIL();", r);
+                emit(fn, "L%zu: ;", label);
+                return r;
+        }
+        case TT_ABS:
+                if (compilable(d, fn)) return compile_fun_value(fn, d, NULL);
+                return compile_interpreted(fn, d);
+        case TT_MU:
+        {
+                struct mu_term *mt = term_as_mu_term(t);
+                if (compilable(mt->body, fn)) {
+                        return compile_fun_value(fn, mt->body, mt->var);
+                }
+                return compile_interpreted(fn, d);
+        }
+        case TT_DEFINE: case TT_CATCH: case TT_LOOP: case TT_DELAY:
+                return compile_interpreted(fn, d);
+        }
+        NOTREACHED;
+}
+
+// emits code returning the value of d, turning self tail calls into
+// jumps
+static void compile_tail(struct cfun *fn, struct datum *d)
+{
+        struct term *t = parse_sexp_as_term(d);
+        if (get_term_type(t) == TT_GUARDED) {
+                for (struct guarded_term *gt = term_as_guarded_term(t);
+                     gt != NULL; gt = gt->next) {
+                        size_t g = compile_expr(fn, gt->guard);
+                        emit(fn, "if (!is_NIL(t%zu)) {", g);
+                        fn->depth++;
+                        compile_tail(fn, gt->term);
+                        fn->depth--;
+                        emit(fn, "}");
+                }
+                emit(fn, "return make_NIL();");
+                return;
+        }
+        if (get_term_type(t) == TT_APP) {
+                struct app_term *at = term_as_app_term(t);
+                struct abs_term *abs = fn->abs;
+                size_t nargs = 0;
+                struct datum *it;
+                for (it = at->right; get_type(it) == T_PAIR;
+                     it = get_pair_second(it)) {
+                        nargs++;
+                }
+                if (get_type(at->left) == T_SYMBOL && is_NIL(it) &&
+                    abs->rest_param_name == NULL && abs->num_params == nargs) {
+                        struct ref ref = resolve(fn, get_symbol_name(at->left));
+                        if (ref.kind == REF_FUN && ref.fun == fn) {
+                                size_t *a = alloc_atomic((nargs + 1) * sizeof *a);
+                                size_t i = 0;
+                                for (it = at->right; get_type(it) == T_PAIR;
+                                     it = get_pair_second(it)) {
+                                        a[i++] = compile_expr(fn,
+                                                              get_pair_first(it));
+                                }
+                                if (ref.global) {
+                                        emit(fn, "if (!*W[%zu]) {", fn->id);
+                                        fn->depth++;
+                                }
+                                for (i = 0; i < nargs; i++) {
+                                        emit(fn, "a%zu = t%zu;", i, a[i]);
+                                }
+                                emit(fn, "goto top;");
+                                fn->tail_calls_self = true;
+                                if (ref.global) {
+                                        fn->depth--;
+                                        emit(fn, "}");
+                                        size_t r = new_temp(fn);
+                                        emit_global_call(fn, at->left, a,
+                                                         nargs, r);
+                                        emit(fn, "return t%zu;", r);
+                                }
+                                return;
+                        }
+                }
+        }
+        emit(fn, "return t%zu;", compile_expr(fn, d));
+}
+
+void compile_c_form(struct datum *d)
+{
+        if (prims == NULL) prims = str_vec_new();
+        struct term *t = parse_sexp_as_term(d);
+        if (get_term_type(t) != TT_DEFINE) {
+                fputs("compile-to-c: skipping a form that is not a DEFINE\n",
+                      stderr);
+                return;
+        }
+        for (struct define_term *dt = term_as_define_term(t); dt != NULL;
+             dt = dt->next) {
+                struct cdef *def = alloc_object(sizeof *def);
+                def->name = dt->name;
+                def->binding = dt->binding;
+                def->fun = NULL;
+                def->next = NULL;
+                if (defs == NULL) {
+                        defs = def;
+                } else {
+                        last_def->next = def;
+                }
+                last_def = def;
+        }
+}
+
+static void write_mangled(FILE *out, const char *name)
+{
+        for (const char *p = name; *p != '\0'; p++) {
+                putc(isalnum((unsigned char)*p) ? *p : '_', out);
+        }
+}
+
+static void write_fun(FILE *out, struct cfun *fn)
+{
+        struct abs_term *abs = fn->abs;
+        fprintf(out, "static struct datum *F%zu(", fn->id);
+        for (size_t i = 0; i < abs->num_params; i++) {
+                fprintf(out, "%sstruct datum *a%zu", i > 0 ? ", " : "", i);
+        }
+        if (abs->rest_param_name != NULL) {
+                fprintf(out, "%sstruct datum *rest",
+                        abs->num_params > 0 ? ", " : "");
+        }
+        if (abs->num_params == 0 && abs->rest_param_name == NULL) {
+                fputs("void", out);
+        }
+        fputs(")\n{\n", out);
+        for (size_t i = 0; i < fn->ntemps; i++) {
+                fprintf(out, "        struct datum *t%zu;\n", i);
+        }
+        if (fn->uses_env) fputs("        struct env *e;\n", out);
+        if (fn->tail_calls_self) fputs("top:\n", out);
+        // every call and self tail call counts against the budgets
+        fputs("        eval_step();\n", out);
+        fwrite(fn->body.s, 1, fn->body.len, out);
+        fputs("}\n\n", out);
+
+        // the entry point unpacks the argument list like apply does
+        fprintf(out, "static struct datum *E%zu(struct datum *arg)\n{\n",
+                fn->id);
+        fputs("        struct datum *it = arg;\n", out);
+        for (size_t i = 0; i < abs->num_params; i++) {
+                fprintf(out, "        if (get_type(it) != T_PAIR) {\n");
+                fprintf(out, "                raise_error(make_pair(G[%zu], arg),\n"
+                        "                            \"Missing a parameter for %%s\",\n"
+                        "                            ", fn->id);
+                struct cbuf b = { NULL, 0, 0 };
+                cbuf_cstring(&b, abs->params[i]);
+                fwrite(b.s, 1, b.len, out);
+                fputs(");\n        }\n", out);
+                fprintf(out, "        struct datum *a%zu = get_pair_first(it);\n", i);
+                fputs("        it = get_pair_second(it);\n", out);
+        }
+        if (abs->rest_param_name == NULL) {
+                fprintf(out, "        if (!is_NIL(it)) {\n"
+                        "                raise_error(make_pair(G[%zu], arg),\n"
+                        "                            \"Too many parameters\");\n"
+                        "        }\n", fn->id);
+        }
+        fprintf(out, "        return F%zu(", fn->id);
+        for (size_t i = 0; i < abs->num_params; i++) {
+                fprintf(out, "%sa%zu", i > 0 ? ", " : "", i);
+        }
+        if (abs->rest_param_name != NULL) {
+                fprintf(out, "%sit", abs->num_params > 0 ? ", " : "");
+        }
+        fputs(");\n}\n\n", out);
+}
+
+void compile_c_finish(FILE *out, const char *source_name)
+{
+        if (prims == NULL) prims = str_vec_new();
+        // decide what gets compiled before compiling anything, so that
+        // calls between the definitions are resolved directly
+        for (struct cdef *def = defs; def != NULL; def = def->next) {
+                struct term *t = parse_sexp_as_term(def->binding);
+                if (get_term_type(t) == TT_ABS && compilable(def->binding, NULL)) {
+                        def->fun = new_cfun(def->name, def->binding, NULL);
+                } else if (get_term_type(t) == TT_MU &&
+                           compilable(term_as_mu_term(t)->body, NULL)) {
+                        struct mu_term *mt = term_as_mu_term(t);
+                        def->fun = new_cfun(def->name, mt->body, mt->var);
+                } else {
+                        def->konst = add_const(def->binding);
+                }
+        }
+        // compiling a function may add more (nested) functions to the list
+        for (struct cfun *fn = funs; fn != NULL; fn = fn->next) {
+                compile_tail(fn, fn->abs->body);
+        }
+
+        fprintf(out, "/* Generated by simple-lisp --compile-to-c from %s. */\n\n",
+                source_name);
+        fputs("#include <stdint.h>\n"
+              "#include \"bignum.h\"\n"
+              "#include \"data.h\"\n"
+              "#include \"env.h\"\n"
+              "#include \"eval.h\"\n"
+              "#include \"number.h\"\n"
+              "#include \"primops.h\"\n\n", out);
+        fprintf(out, "static struct datum *K[%zu];\n", nconsts > 0 ? nconsts : 1);
+        if (uses_prim_table) {
+                fprintf(out, "static prim_fun P[%zu];\n", str_vec_len(prims));
+        }
+        if (str_vec_len(prims) > 0) {
+                fprintf(out, "static const _Bool *R[%zu];\n",
+                        str_vec_len(prims));
+        }
+        fprintf(out, "static struct datum *G[%zu];\n", nfuns > 0 ? nfuns : 1);
+        fprintf(out, "static const _Bool *W[%zu];\n", nfuns > 0 ? nfuns : 1);
+        fputs("static struct env *genv;\n\n", out);
+        if (uses_global_ref) {
+                fputs("static struct datum *global_ref(struct datum *var)\n"
+                      "{\n"
+                      "        struct datum *d;\n"
+                      "        if (!env_lookup(genv, get_symbol_name(var), &d)) {\n"
+                      "                raise_error(var, \"ERROR: Undefined variable\");\n"
+                      "        }\n"
+                      "        if (is_blackhole(d)) raise_error_value(d);\n"
+                      "        return d;\n"
+                      "}\n\n", out);
+        }
+        for (struct cfun *fn = funs; fn != NULL; fn = fn->next) {
+                fprintf(out, "static struct datum *F%zu(", fn->id);
+                size_t n = fn->abs->num_params
+                        + (fn->abs->rest_param_name != NULL);
+                for (size_t i = 0; i < n; i++) {
+                        fprintf(out, "%sstruct datum *", i > 0 ? ", " : "");
+                }
+                fprintf(out, "%s);", n == 0 ? "void" : "");
+                if (fn->name != NULL) {
+                        fputs(" // ", out);
+                        write_mangled(out, fn->name);
+                }
+                fputs("\n", out);
+        }
+        fputs("\n", out);
+        for (struct cfun *fn = funs; fn != NULL; fn = fn->next) {
+                write_fun(out, fn);
+        }
+
+        fputs("void register_compiled_primops(struct env *env)\n{\n", out);
+        fputs("        genv = env;\n", out);
+        fwrite(consts.s, 1, consts.len, out);
+        const char **pv = str_vec_to_array(prims);
+        for (size_t i = 0; i < str_vec_len(prims); i++) {
+                if (uses_prim_table) {
+                        fprintf(out, "        P[%zu] = get_primop(\"%s\");\n",
+                                i, pv[i]);
+                }
+                fprintf(out, "        R[%zu] = get_primop_rebound_flag(\"%s\");\n",
+                        i, pv[i]);
+        }
+        for (struct cfun *fn = funs; fn != NULL; fn = fn->next) {
+                fprintf(out, "        G[%zu] = make_primitive(E%zu);\n",
+                        fn->id, fn->id);
+        }
+        struct cbuf b = { NULL, 0, 0 };
+        for (struct cdef *def = defs; def != NULL; def = def->next) {
+                b.len = 0;
+                cbuf_cstring(&b, def->name);
+                if (def->fun != NULL) {
+                        fprintf(out, "        env_bind(env, %.*s, G[%zu]);\n",
+                                (int)b.len, b.s, def->fun->id);
+                        fprintf(out, "        W[%zu] = env_watch(%.*s, G[%zu]);\n",
+                                def->fun->id, (int)b.len, b.s, def->fun->id);
+                }
+        }
+        for (struct cdef *def = defs; def != NULL; def = def->next) {
+                b.len = 0;
+                cbuf_cstring(&b, def->name);
+                if (def->fun == NULL) {
+                        fprintf(out, "        env_bind(env, %.*s, "
+                                "eval_in_env(K[%zu], env));\n",
+                                (int)b.len, b.s, def->konst);
+                }
+        }
+        fputs("}\n", out);
+}
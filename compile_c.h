@@ -26,48 +26,31 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
  
-%{
-#include <stdio.h>
-#include <strings.h>
+#ifndef GUARD_COMPILE_C_H
+#define GUARD_COMPILE_C_H
 
+#include <stdio.h>
 #include "data.h"
-#include "eval.h"
-#include "lexer.h"
-#include "printer.h"
-
-#define YYSTYPE struct datum *
-%}
-
-%token ATOM
-%token INTERACTIVE NONINTERACTIVE
-
-%%
 
-input : /**/
-      | input INTERACTIVE session
-      | input NONINTERACTIVE script
+/* Ahead-of-time translation of Lisp definitions into C.
 
-session : /**/
-        | session sexp { print_sexp(eval($2), stdout); putchar('\n'); }
+   Each top-level (DEFINE (name (LAMBDA ...)) ...) passed to
+   compile_c_form becomes a C function that is bound to name as a
+   primitive when the generated file is linked into the interpreter
+   (see register_compiled_primops in primops.h).  Within the compiled
+   code, primitives and functions defined in the same compilation are
+   called directly; other free variables are looked up in the global
+   environment when evaluated.  Subterms that cannot be translated
+   (such as lambdas closing over local variables) are evaluated by
+   the interpreter in an environment holding the local variables, so
+   that the result is the same as that of eval.
+ */
 
-script : /**/
-       | script sexp   { eval($2); }
+/* Adds a top-level form to the compilation.  Forms other than DEFINE
+   are reported on stderr and skipped. */
+void compile_c_form(struct datum *);
 
-sexp : ATOM                       { $$ = $1; }
-     | '(' ')'                    { $$ = make_NIL(); }
-     | '(' sexp_list ')'          { $$ = $2; }
-     | '\'' sexp                  { $$ = make_pair(make_QUOTE(),
-                                                   make_pair($2, make_NIL())); }
+/* Writes the C translation of all forms added so far. */
+void compile_c_finish(FILE *out, const char *source_name);
 
-sexp_list : sexp_list_init          { $$ = get_pair_first($1); }
-          | sexp_list_init '.' sexp { set_pair_second(get_pair_second($1), $3);
-                                      $$ = get_pair_first($1); }
-            
-sexp_list_init :
-  sexp                { $$ = make_pair($1, make_NIL());
-                        $$ = make_pair($$, $$); }
-| sexp_list_init sexp { struct datum *n = make_pair($2, make_NIL());
-                        set_pair_second(get_pair_second($1), n);
-                        set_pair_second($1, n);
-                        $$ = $1;
-                       }
+#endif /* GUARD_COMPILE_C_H */
@@ -45,4 +45,10 @@
 #  define FORMAT(f,x,y,z) f
 #endif
 
+#if defined(__GNUC__) || __has_attribute(weak)
+#  define WEAK(x) x __attribute__((weak))
+#else
+#  define WEAK(x) x
+#endif
+
 #endif /* GUARD_CONFIG_H */
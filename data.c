@@ -27,87 +27,239 @@
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
 #include <assert.h>
-#include <gc.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
+#include "alloc.h"
+#include "bignum.h"
 #include "data.h"
 #include "env.h"
 #include "error.h"
+#include "hash.h"
+#include "number.h"
+#include "pvec.h"
 
-struct datum {
+/* A struct datum * is never dereferenced as such; it is a tagged
+   pointer.  Pairs, by far the most common data, are two words with no
+   header, and a pointer to a pair carries TAG_PAIR in its low bits.
+   Integers that fit in the remaining bits of a pointer (fixnums) are
+   not pointers at all but carry their value shifted left past
+   TAG_FIXNUM.  Everything else is a struct object with a type header,
+   pointed to by an untagged pointer; larger integers are T_INTEGER
+   objects holding a bignum.  NIL, T and QUOTE are statically
+   allocated symbol objects.
+ */
+
+enum {
+        TAG_OBJECT = 0,
+        TAG_PAIR = 1,
+        TAG_FIXNUM = 2,
+};
+
+#define TAG_BITS 3
+#define FIXNUM_MIN (INTPTR_MIN >> TAG_BITS)
+#define FIXNUM_MAX (INTPTR_MAX >> TAG_BITS)
+
+struct pair {
+        struct datum *first;
+        struct datum *second;
+};
+
+struct object {
         enum data_type type;
         union {
+                // T_ERROR: the message is formatted only when needed;
+                // every conversion in fmt is a %s taking one of args
                 struct {
-                        struct datum *first;
-                        struct datum *second;
-                } pair;                
+                        const char *fmt;
+                        const char **args;
+                        struct datum *where;
+                        struct datum *backtrace;
+                        _Bool blackhole;
+                } error;
                 struct {
                         struct datum *fun;
                         struct env *env;
-                } closure;                
+                        struct code *code; // NULL until compiled
+                        const char *name;  // NULL until bound
+                } closure;
+                struct {
+                        struct datum *fun;
+                        struct datum *arg;
+                        struct datum *value; // NULL until forced
+                } promise;
                 double number;
+                struct bignum *bignum;
+                struct hash *hash;
+                struct pvec *vector;
+                struct {
+                        size_t n;
+                        double *data;
+                        // the allocation data points into, since only
+                        // pointers to the start keep objects alive
+                        void *base;
+                } f64vec;
                 const char *symbol;
                 prim_fun primitive;
         } u;
 };
 
-struct datum *make_pair(struct datum *first, struct datum *second)
+static struct object nil_object = { T_SYMBOL, { .symbol = "NIL" } };
+static struct object t_object = { T_SYMBOL, { .symbol = "T" } };
+static struct object quote_object = { T_SYMBOL, { .symbol = "QUOTE" } };
+static struct object eof_object = { T_SYMBOL, { .symbol = "#<end of file>" } };
+
+static inline uintptr_t tag_of(struct datum *d)
+{
+        return (uintptr_t)d & ALLOC_TAG_MASK;
+}
+
+static inline struct pair *as_pair(struct datum *d)
+{
+        assert(tag_of(d) == TAG_PAIR);
+        return (struct pair *)((uintptr_t)d - TAG_PAIR);
+}
+
+static inline struct object *as_object(struct datum *d)
+{
+        assert(tag_of(d) == TAG_OBJECT);
+        return (struct object *)d;
+}
+
+static inline struct datum *from_object(struct object *o)
+{
+        return (struct datum *)o;
+}
+
+// the number of bytes needed for an object using the given union member;
+// numbers, symbols and primitives fit in two words
+#define OBJECT_SIZE(member) \
+        (offsetof(struct object, u) + sizeof ((struct object *)0)->u.member)
+
+static struct object *new_object(enum data_type type, size_t size)
 {
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
-        rv->type = T_PAIR;
-        rv->u.pair.first = first;
-        rv->u.pair.second = second;
+        enum alloc_kind kind = ALLOC_OTHER;
+        switch (type) {
+        case T_INTEGER: kind = ALLOC_NUMBER; break;
+        case T_SYMBOL: kind = ALLOC_SYMBOL; break;
+        case T_CLOSURE: kind = ALLOC_CLOSURE; break;
+        default: break;
+        }
+        struct object *rv = alloc_object_of(kind, size);
+        rv->type = type;
         return rv;
 }
+
+struct datum *make_pair(struct datum *first, struct datum *second)
+{
+        struct pair *rv = alloc_object_of(ALLOC_PAIR, sizeof *rv);
+        rv->first = first;
+        rv->second = second;
+        return (struct datum *)((uintptr_t)rv + TAG_PAIR);
+}
 struct datum *make_closure(struct datum *body,
                            struct env *env)
 {
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
-        rv->type = T_CLOSURE;
+        struct object *rv = new_object(T_CLOSURE, OBJECT_SIZE(closure));
         rv->u.closure.fun = body;
         rv->u.closure.env = env;
-        return rv;
+        return from_object(rv);
+}
+struct datum *make_promise(struct datum *fun, struct datum *arg)
+{
+        struct object *rv = new_object(T_PROMISE, OBJECT_SIZE(promise));
+        rv->u.promise.fun = fun;
+        rv->u.promise.arg = arg;
+        rv->u.promise.value = NULL;
+        return from_object(rv);
 }
 struct datum *make_numeric_atom(double val)
 {
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
+        // numbers contain no pointers, so the collector need not scan them
+        struct object *rv = alloc_atomic_of(ALLOC_NUMBER,
+                                            OBJECT_SIZE(number));
         rv->type = T_NUMBER;
         rv->u.number = val;
-        return rv;
+        return from_object(rv);
 }
         
+struct datum *make_integer_atom(int64_t val)
+{
+        if (val >= FIXNUM_MIN && val <= FIXNUM_MAX) {
+                return (struct datum *)(((uintptr_t)(intptr_t)val << TAG_BITS)
+                                        | TAG_FIXNUM);
+        }
+        return make_bignum_atom(bignum_from_int64(val));
+}
+
+struct datum *make_bignum_atom(struct bignum *val)
+{
+        int64_t small;
+        if (bignum_to_int64(val, &small) &&
+            small >= FIXNUM_MIN && small <= FIXNUM_MAX) {
+                return make_integer_atom(small);
+        }
+        struct object *rv = new_object(T_INTEGER, OBJECT_SIZE(bignum));
+        rv->u.bignum = val;
+        return from_object(rv);
+}
+
+struct datum *make_hash_table(void)
+{
+        struct object *rv = new_object(T_HASH, OBJECT_SIZE(hash));
+        rv->u.hash = hash_new();
+        return from_object(rv);
+}
+
+struct datum *make_f64vec(size_t n)
+{
+        struct object *rv = new_object(T_F64VEC, OBJECT_SIZE(f64vec));
+        char *base = alloc_atomic(n * sizeof(double) + 31);
+        rv->u.f64vec.n = n;
+        rv->u.f64vec.data = (double *)(((uintptr_t)base + 31)
+                                       & ~(uintptr_t)31);
+        rv->u.f64vec.base = base;
+        return from_object(rv);
+}
+
+struct datum *make_vector(struct pvec *v)
+{
+        struct object *rv = new_object(T_VECTOR, OBJECT_SIZE(vector));
+        rv->u.vector = v;
+        return from_object(rv);
+}
+
+struct datum *make_vector_from_list(struct datum *list)
+{
+        struct list_data ld = get_list_data(list);
+        assert(is_NIL(ld.terminator));
+        return make_vector(pvec_from_array(ld.vec, ld.n));
+}
+
 struct datum *make_primitive(prim_fun fun)
 {
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
-        rv->type = T_PRIMITIVE;
+        struct object *rv = new_object(T_PRIMITIVE, OBJECT_SIZE(primitive));
         rv->u.primitive = fun;
-        return rv;
+        return from_object(rv);
 }
 
 static struct datum *make_symbolic_atom_reusing_name(const char *name,
                                                      size_t len)
 {
         if (len == 3 && strncasecmp(name, "NIL", len) == 0) return make_NIL();
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
-        rv->type = T_SYMBOL;
+        struct object *rv = new_object(T_SYMBOL, OBJECT_SIZE(symbol));
         rv->u.symbol = name;
-        return rv;
+        return from_object(rv);
 }
 
 struct datum *make_symbolic_atom(const char *name, size_t len)
 {
         if (len == 3 && strncasecmp(name, "NIL", len) == 0) return make_NIL();
-        char * s = GC_malloc_atomic(len+1);
-        if (s == 0) enomem();
+        char * s = alloc_atomic_of(ALLOC_SYMBOL, len+1);
         memcpy(s, name, len);
         s[len] = '\0';
         return make_symbolic_atom_reusing_name(s, len);
@@ -118,86 +270,219 @@ struct datum *make_symbolic_atom_cstr(const char *name)
         return make_symbolic_atom(name, strlen(name));
 }
 
+struct datum *make_error_va(struct datum *where, const char *fmt,
+                            va_list ap)
+{
+        size_t n = 0;
+        for (const char *p = fmt; *p != '\0'; p++) {
+                if (*p != '%') continue;
+                p++;
+                if (*p == 's') {
+                        n++;
+                } else if (*p != '%') {
+                        NOTREACHED;
+                }
+        }
+        struct object *rv = new_object(T_ERROR, OBJECT_SIZE(error));
+        rv->u.error.fmt = fmt;
+        rv->u.error.args = n > 0 ? alloc_object(n * sizeof *rv->u.error.args)
+                                 : NULL;
+        for (size_t i = 0; i < n; i++) {
+                rv->u.error.args[i] = va_arg(ap, const char *);
+        }
+        rv->u.error.where = where;
+        rv->u.error.backtrace = make_NIL();
+        return from_object(rv);
+}
+
 struct datum *make_error(struct datum *where, const char *fmt, ...)
 {
-        va_list ap, ap1;
+        va_list ap;
         va_start(ap, fmt);
-        va_copy(ap1, ap);
-        int n = vsnprintf(NULL, 0, fmt, ap);
-        if (n < 0) NOTREACHED;
-        char *s = GC_malloc_atomic(n+1);
-        if (s == NULL) enomem();
-        int m = vsnprintf(s, n+1, fmt, ap1);
-        if (m < 0) NOTREACHED;
-        va_end(ap1);
+        struct datum *rv = make_error_va(where, fmt, ap);
         va_end(ap);
+        return rv;
+}
 
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == NULL) enomem();
-        rv->type = T_ERROR;
-        rv->u.pair.first = make_symbolic_atom_reusing_name(s, n);
-        rv->u.pair.second = make_pair(make_pair(where, make_NIL()),
-                                      make_NIL());
+struct datum *make_blackhole(struct datum *where, const char *fmt, ...)
+{
+        va_list ap;
+        va_start(ap, fmt);
+        struct datum *rv = make_error_va(where, fmt, ap);
+        va_end(ap);
+        as_object(rv)->u.error.blackhole = 1;
         return rv;
 }
 
+_Bool is_blackhole(struct datum *d)
+{
+        return get_type(d) == T_ERROR && as_object(d)->u.error.blackhole;
+}
+
+const char *get_error_message(struct datum *d)
+{
+        assert(get_type(d) == T_ERROR);
+        const char *fmt = as_object(d)->u.error.fmt;
+        const char **args = as_object(d)->u.error.args;
+        size_t len = 0;
+        size_t n = 0;
+        for (const char *p = fmt; *p != '\0'; p++) {
+                if (p[0] == '%' && p[1] == 's') {
+                        len += strlen(args[n++]);
+                        p++;
+                } else {
+                        if (p[0] == '%') p++;
+                        len++;
+                }
+        }
+        char *s = alloc_atomic(len + 1);
+        char *q = s;
+        n = 0;
+        for (const char *p = fmt; *p != '\0'; p++) {
+                if (p[0] == '%' && p[1] == 's') {
+                        size_t m = strlen(args[n]);
+                        memcpy(q, args[n++], m);
+                        q += m;
+                        p++;
+                } else {
+                        if (p[0] == '%') p++;
+                        *q++ = *p;
+                }
+        }
+        *q = '\0';
+        return s;
+}
+
+struct datum *get_error_backtrace(struct datum *d)
+{
+        assert(get_type(d) == T_ERROR);
+        return as_object(d)->u.error.backtrace;
+}
+
+void set_error_backtrace(struct datum *d, struct datum *backtrace)
+{
+        assert(get_type(d) == T_ERROR);
+        as_object(d)->u.error.backtrace = backtrace;
+}
+
 struct datum *make_NIL(void) {
-        return NULL;
+        return from_object(&nil_object);
 }
 
 struct datum *make_QUOTE(void) {
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
-        rv->type = T_SYMBOL;
-        rv->u.symbol = "QUOTE";
-        return rv;
+        return from_object(&quote_object);
 }
 
 struct datum *make_T(void) {
-        struct datum *rv = GC_malloc(sizeof *rv);
-        if (rv == 0) enomem();
-        rv->type = T_SYMBOL;
-        rv->u.symbol = "T";
-        return rv;
+        return from_object(&t_object);
+}
+
+struct datum *make_EOF(void) {
+        return from_object(&eof_object);
 }
 
 _Bool is_NIL(struct datum *d)
 {
-        return d == NULL;
+        return d == from_object(&nil_object);
+}
+
+_Bool is_EOF(struct datum *d)
+{
+        return d == from_object(&eof_object);
 }
 
 enum data_type get_type(struct datum *d)
 {
-        if (d == NULL) return T_SYMBOL;
-        return d->type;
+        switch (tag_of(d)) {
+        case TAG_PAIR: return T_PAIR;
+        case TAG_FIXNUM: return T_INTEGER;
+        default: return as_object(d)->type;
+        }
 }
 
 struct datum *apply_primitive(struct datum *prim,
                               struct datum *arg)
 {
-        assert(prim->type == T_PRIMITIVE);
-        return prim->u.primitive(arg);
+        assert(get_type(prim) == T_PRIMITIVE);
+        return as_object(prim)->u.primitive(arg);
 }
 
+// an error reads as the list (message (where))
 struct datum *get_pair_first(struct datum *d)
 {
-        assert(d->type == T_PAIR || d->type == T_ERROR);
-        return d->u.pair.first;
+        if (tag_of(d) == TAG_PAIR) return as_pair(d)->first;
+        const char *msg = get_error_message(d);
+        return make_symbolic_atom_reusing_name(msg, strlen(msg));
 }
 struct datum *get_pair_second(struct datum *d)
 {
-        assert(d->type == T_PAIR || d->type == T_ERROR);
-        return d->u.pair.second;
+        if (tag_of(d) == TAG_PAIR) return as_pair(d)->second;
+        assert(as_object(d)->type == T_ERROR);
+        return make_pair(make_pair(as_object(d)->u.error.where, make_NIL()),
+                         make_NIL());
 }
 struct datum *get_closure_fun(struct datum *d)
 {
-        assert(d->type == T_CLOSURE);
-        return d->u.closure.fun;
+        assert(get_type(d) == T_CLOSURE);
+        return as_object(d)->u.closure.fun;
 }
 struct env *get_closure_env(struct datum *d)
 {
-        assert(d->type == T_CLOSURE);
-        return d->u.closure.env;
+        assert(get_type(d) == T_CLOSURE);
+        return as_object(d)->u.closure.env;
+}
+struct code *get_closure_code(struct datum *d)
+{
+        assert(get_type(d) == T_CLOSURE);
+        return as_object(d)->u.closure.code;
+}
+void set_closure_code(struct datum *d, struct code *code)
+{
+        assert(get_type(d) == T_CLOSURE);
+        as_object(d)->u.closure.code = code;
+}
+
+const char *get_closure_name(struct datum *d)
+{
+        assert(get_type(d) == T_CLOSURE);
+        return as_object(d)->u.closure.name;
+}
+
+void name_closure(struct datum *d, const char *name)
+{
+        if (get_type(d) != T_CLOSURE) return;
+        struct object *o = as_object(d);
+        if (o->u.closure.name != NULL) return;
+        o->u.closure.name = name;
+}
+
+prim_fun get_primitive_fun(struct datum *d)
+{
+        assert(get_type(d) == T_PRIMITIVE);
+        return as_object(d)->u.primitive;
+}
+struct datum *get_promise_value(struct datum *d)
+{
+        assert(get_type(d) == T_PROMISE);
+        return as_object(d)->u.promise.value;
+}
+struct datum *get_promise_fun(struct datum *d)
+{
+        assert(get_type(d) == T_PROMISE);
+        return as_object(d)->u.promise.fun;
+}
+struct datum *get_promise_arg(struct datum *d)
+{
+        assert(get_type(d) == T_PROMISE);
+        return as_object(d)->u.promise.arg;
+}
+void set_promise_value(struct datum *d, struct datum *value)
+{
+        assert(get_type(d) == T_PROMISE);
+        struct object *o = as_object(d);
+        o->u.promise.value = value;
+        o->u.promise.fun = NULL;
+        o->u.promise.arg = NULL;
 }
 
 
@@ -207,60 +492,230 @@ struct list_data get_list_data(struct datum *d)
         size_t maxn = 0;
         size_t n = 0;
         struct datum **vec = NULL;
-        while (d != NULL && d->type == T_PAIR) {
-                if (maxn >= n) {
-                        maxn = maxn == 0 ? 2 : 2*maxn;
-                        vec = GC_realloc(vec, maxn * sizeof *vec);
-                        if (vec == NULL) enomem();
+        while (tag_of(d) == TAG_PAIR) {
+                if (n == maxn) {
+                        maxn = maxn == 0 ? 4 : 2*maxn;
+                        vec = vec == NULL
+                                ? alloc_object_of(ALLOC_ARGS,
+                                                  maxn * sizeof *vec)
+                                : alloc_realloc(vec, maxn * sizeof *vec);
                 }
-                vec[n++] = d->u.pair.first;
-                d = d->u.pair.second;
+                struct pair *p = as_pair(d);
+                vec[n++] = p->first;
+                d = p->second;
         }
         return (struct list_data) { .n = n, .vec = vec, .terminator = d };
 }
 
 void set_pair_second(struct datum *d, struct datum *replacement)
 {
-        assert(d->type == T_PAIR);
-        d->u.pair.second = replacement;
+        struct pair *p = as_pair(d);
+        p->second = replacement;
 }
 
 double get_numeric_value(struct datum *d)
 {
-        assert(d->type == T_NUMBER);
-        return d->u.number;
+        if (is_fixnum(d)) return (double)get_fixnum_value(d);
+        if (get_type(d) == T_INTEGER) {
+                return bignum_to_double(as_object(d)->u.bignum);
+        }
+        assert(get_type(d) == T_NUMBER);
+        return as_object(d)->u.number;
+}
+
+_Bool is_fixnum(struct datum *d)
+{
+        return tag_of(d) == TAG_FIXNUM;
+}
+
+int64_t get_fixnum_value(struct datum *d)
+{
+        assert(is_fixnum(d));
+        return (intptr_t)d >> TAG_BITS;
+}
+
+_Bool fixnum_in_range(int64_t val)
+{
+        return val >= FIXNUM_MIN && val <= FIXNUM_MAX;
+}
+
+struct hash *get_hash_table(struct datum *d)
+{
+        assert(get_type(d) == T_HASH);
+        return as_object(d)->u.hash;
+}
+
+struct pvec *get_vector(struct datum *d)
+{
+        assert(get_type(d) == T_VECTOR);
+        return as_object(d)->u.vector;
+}
+
+struct datum *vector_to_list(struct datum *d)
+{
+        struct pvec *v = get_vector(d);
+        struct datum *rv = make_NIL();
+        for (size_t i = pvec_length(v); i-- > 0; ) {
+                rv = make_pair(pvec_ref(v, i), rv);
+        }
+        return rv;
+}
+
+size_t get_f64vec_length(struct datum *d)
+{
+        assert(get_type(d) == T_F64VEC);
+        return as_object(d)->u.f64vec.n;
+}
+
+double *get_f64vec_data(struct datum *d)
+{
+        assert(get_type(d) == T_F64VEC);
+        return as_object(d)->u.f64vec.data;
+}
+
+struct bignum *get_bignum_value(struct datum *d)
+{
+        if (is_fixnum(d)) return bignum_from_int64(get_fixnum_value(d));
+        assert(get_type(d) == T_INTEGER);
+        return as_object(d)->u.bignum;
 }
 
 const char *get_symbol_name(struct datum *d)
 {
-        if (d == NULL) return "NIL";
-        assert(d->type == T_SYMBOL);
-        return d->u.symbol;
+        assert(get_type(d) == T_SYMBOL);
+        return as_object(d)->u.symbol;
 }
 
 _Bool is_this_symbol(struct datum *d, const char *name)
 {
-        if (d == NULL) return strcasecmp("NIL", name) == 0;
-        if (d->type != T_SYMBOL) return 0;
-        return strcasecmp(d->u.symbol, name) == 0;
+        if (get_type(d) != T_SYMBOL) return 0;
+        return strcasecmp(as_object(d)->u.symbol, name) == 0;
 }
 
-struct datum *make_deep_copy(struct datum *d)
+static struct datum *copy_atom(struct datum *d)
 {
-        if (d == NULL) return NULL;
-        switch (d->type) {
-        case T_PAIR:
-                return make_pair(make_deep_copy(d->u.pair.first),
-                                 make_deep_copy(d->u.pair.second));
+        switch (get_type(d)) {
         case T_NUMBER:
-                return make_numeric_atom(d->u.number);
+                return make_numeric_atom(get_numeric_value(d));
+        case T_INTEGER:
+                // integers are immutable and may be shared
+                return d;
         case T_SYMBOL:
-                return make_symbolic_atom_reusing_name(d->u.symbol,
-                                                       strlen(d->u.symbol));
+                return make_symbolic_atom_reusing_name(get_symbol_name(d),
+                                                       strlen(get_symbol_name(d)));
         default:
                 fprintf(stderr,
                         "Internal error in make_deep_copy (%d)",
-                        d->type);
+                        get_type(d));
                 exit(EXIT_FAILURE);
         }
 }
+
+/* A growable stack of data used by the routines below to walk nested
+   lists without recursion.  It starts in the caller's frame and moves
+   to the heap when it outgrows that. */
+struct data_stack {
+        struct datum **vec;
+        size_t n, cap;
+        struct datum *local[32];
+};
+
+static void data_stack_init(struct data_stack *st)
+{
+        st->vec = st->local;
+        st->n = 0;
+        st->cap = sizeof st->local / sizeof *st->local;
+}
+
+static void data_stack_push(struct data_stack *st, struct datum *d)
+{
+        if (st->n == st->cap) {
+                struct datum **vec = alloc_object(2 * st->cap * sizeof *vec);
+                memcpy(vec, st->vec, st->n * sizeof *vec);
+                st->vec = vec;
+                st->cap *= 2;
+        }
+        st->vec[st->n++] = d;
+}
+
+struct datum *make_deep_copy(struct datum *d)
+{
+        if (tag_of(d) != TAG_PAIR) return copy_atom(d);
+        // Each list is copied along its cdrs in a loop; a car that is
+        // itself a pair is left for later, and the stack holds pairs
+        // of (original car, copy whose first is to be filled in).
+        struct data_stack st;
+        data_stack_init(&st);
+        struct datum *root = NULL;
+        data_stack_push(&st, d);
+        data_stack_push(&st, NULL);
+        while (st.n > 0) {
+                struct datum *dst = st.vec[--st.n];
+                struct datum *src = st.vec[--st.n];
+                struct pair *tail = NULL;
+                while (tag_of(src) == TAG_PAIR) {
+                        struct datum *first = as_pair(src)->first;
+                        struct datum *p = make_pair(NULL, make_NIL());
+                        if (tag_of(first) == TAG_PAIR) {
+                                data_stack_push(&st, first);
+                                data_stack_push(&st, p);
+                        } else {
+                                as_pair(p)->first = copy_atom(first);
+                        }
+                        if (tail != NULL) {
+                                tail->second = p;
+                        } else if (dst != NULL) {
+                                as_pair(dst)->first = p;
+                        } else {
+                                root = p;
+                        }
+                        tail = as_pair(p);
+                        src = as_pair(src)->second;
+                }
+                if (!is_NIL(src)) {
+                        tail->second = copy_atom(src);
+                }
+        }
+        return root;
+}
+
+_Bool data_equal(struct datum *a, struct datum *b)
+{
+        // the stack holds the cdrs and vector elements still to be
+        // compared, two by two
+        struct data_stack st;
+        data_stack_init(&st);
+        for (;;) {
+                while (tag_of(a) == TAG_PAIR && tag_of(b) == TAG_PAIR) {
+                        data_stack_push(&st, as_pair(a)->second);
+                        data_stack_push(&st, as_pair(b)->second);
+                        a = as_pair(a)->first;
+                        b = as_pair(b)->first;
+                }
+                if (a != b) {
+                        if (is_number(a) && is_number(b)) {
+                                if (!number_equal(a, b)) return 0;
+                        } else if (get_type(a) == T_SYMBOL
+                                   && get_type(b) == T_SYMBOL) {
+                                if (!is_this_symbol(a, get_symbol_name(b))) {
+                                        return 0;
+                                }
+                        } else if (get_type(a) == T_VECTOR
+                                   && get_type(b) == T_VECTOR) {
+                                struct pvec *va = get_vector(a);
+                                struct pvec *vb = get_vector(b);
+                                size_t n = pvec_length(va);
+                                if (n != pvec_length(vb)) return 0;
+                                for (size_t i = n; i-- > 0; ) {
+                                        data_stack_push(&st, pvec_ref(va, i));
+                                        data_stack_push(&st, pvec_ref(vb, i));
+                                }
+                        } else {
+                                return 0;
+                        }
+                }
+                if (st.n == 0) return 1;
+                b = st.vec[--st.n];
+                a = st.vec[--st.n];
+        }
+}
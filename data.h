@@ -30,43 +30,86 @@
 #ifndef GUARD_DATA_H
 #define GUARD_DATA_H
 
+#include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "config.h"
 
+struct bignum;
+struct code;
 struct datum;
 struct env;
+struct hash;
+struct pvec;
 
 // prim_fun is the name of the type of functions from struct datum *
 // to struct datum *
 typedef struct datum *(*prim_fun)(struct datum *);
 
+// A fast path for a primitive of one or two arguments (b is NULL for
+// one).  It returns NULL when it does not apply (for example, on a
+// type error), in which case the primitive itself is called.
+typedef struct datum *(*fast_fun)(struct datum *a, struct datum *b);
+
 enum data_type {
         T_PAIR,
-        T_NUMBER,
+        T_NUMBER,   // floating point
+        T_INTEGER,  // exact, of any size
         T_SYMBOL,
+        T_HASH,     // a mutable hash table (hash.h)
+        T_F64VEC,   // a packed array of doubles (f64vec.h)
+        T_VECTOR,   // an immutable vector of data (pvec.h)
         // internal data types
         T_ERROR,
         T_PRIMITIVE,
         T_CLOSURE,
+        T_PROMISE,  // made by DELAY, or by the stream primitives
 };
 
 struct datum *make_pair(struct datum *, struct datum *);
 struct datum *make_numeric_atom(double);
+struct datum *make_integer_atom(int64_t);
+struct datum *make_bignum_atom(struct bignum *);
+struct datum *make_hash_table(void);
+// the n elements are not initialized
+struct datum *make_f64vec(size_t n);
+struct datum *make_vector(struct pvec *);
+// the list must be proper
+struct datum *make_vector_from_list(struct datum *);
 struct datum *make_symbolic_atom(const char *name, size_t len);
 struct datum *make_symbolic_atom_cstr(const char *name);
+// The message is formatted lazily: the only conversion allowed in fmt
+// is %s, and the strings must not be modified afterwards.  To signal
+// an error, use raise_error in eval.h instead.
 FORMAT(struct datum *make_error(struct datum *where, const char *fmt,
                                 ...), printf, 2, 3);
+struct datum *make_error_va(struct datum *where, const char *fmt, va_list);
+// an error bound to a variable that raises the error when evaluated
+FORMAT(struct datum *make_blackhole(struct datum *where, const char *fmt,
+                                    ...), printf, 2, 3);
 struct datum *make_primitive(prim_fun fun);
 struct datum *make_closure(struct datum *body,
                            struct env *env);
+// a promise whose value, when first forced, is that of fun applied to
+// the argument list arg
+struct datum *make_promise(struct datum *fun, struct datum *arg);
 struct datum *make_T(void);
 struct datum *make_NIL(void);
 struct datum *make_QUOTE(void);
+// the value READ returns at the end of input; its name cannot be read
+struct datum *make_EOF(void);
 
 struct datum *make_deep_copy(struct datum *);
 
+// Structural equality: pairs are compared element by element, numbers
+// by value and symbols by name; other data are equal only to
+// themselves.  Like make_deep_copy, this runs in constant C stack
+// however long or deeply nested the data are.
+_Bool data_equal(struct datum *, struct datum *);
+
 enum data_type get_type(struct datum *);
 _Bool is_NIL(struct datum *);
+_Bool is_EOF(struct datum *);
 
 struct datum *apply_primitive(struct datum *prim,
                               struct datum *arg);
@@ -76,6 +119,23 @@ struct datum *get_pair_second(struct datum *);
 
 struct datum *get_closure_fun(struct datum *);
 struct env *get_closure_env(struct datum *);
+// the compiled form of the closure's function (see compile.h), or NULL
+struct code *get_closure_code(struct datum *);
+void set_closure_code(struct datum *, struct code *);
+// the name the closure was first bound to by DEFINE or LABEL, or NULL
+const char *get_closure_name(struct datum *);
+// gives d the name, if it is a closure without one
+void name_closure(struct datum *d, const char *name);
+
+prim_fun get_primitive_fun(struct datum *);
+
+// defined for T_PROMISE: the value, or NULL if it has not been forced
+struct datum *get_promise_value(struct datum *);
+// defined for T_PROMISE that has not been forced
+struct datum *get_promise_fun(struct datum *);
+struct datum *get_promise_arg(struct datum *);
+// remembers the value of the promise, and forgets its fun and arg
+void set_promise_value(struct datum *, struct datum *value);
 
 struct list_data {
         size_t n;
@@ -86,8 +146,38 @@ struct list_data get_list_data(struct datum *);
 
 void set_pair_second(struct datum *pair, struct datum *replacement);
 
+// defined for T_NUMBER and T_INTEGER (converted to the nearest double)
 double get_numeric_value(struct datum *);
 
+// Small integers (fixnums) are stored unboxed, and arithmetic on them
+// should not go through bignums
+_Bool is_fixnum(struct datum *);
+int64_t get_fixnum_value(struct datum *);
+// true if make_integer_atom would return a fixnum for the value
+_Bool fixnum_in_range(int64_t);
+
+// defined for T_INTEGER (fixnums are converted)
+struct bignum *get_bignum_value(struct datum *);
+
+// defined for T_HASH
+struct hash *get_hash_table(struct datum *);
+
+// defined for T_VECTOR
+struct pvec *get_vector(struct datum *);
+// a fresh list of the elements of a T_VECTOR
+struct datum *vector_to_list(struct datum *);
+
+// defined for T_F64VEC; the elements are 32-byte aligned
+size_t get_f64vec_length(struct datum *);
+double *get_f64vec_data(struct datum *);
+
+_Bool is_blackhole(struct datum *);
+// defined for T_ERROR
+const char *get_error_message(struct datum *);
+// the calls active when the error was raised, innermost first
+struct datum *get_error_backtrace(struct datum *);
+void set_error_backtrace(struct datum *, struct datum *);
+
 const char *get_symbol_name(struct datum *);
 _Bool is_this_symbol(struct datum *, const char *);
 
@@ -26,10 +26,13 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
-#include <gc.h>
+#include <assert.h>
+#include <ctype.h>
+#include "alloc.h"
 #include <strings.h>
 #include "env.h"
 #include "error.h"
+#include "primops.h"
 
 /* I use here simple binary search trees.  Since I have cloned trees
    share storage, no node will be modified after initial insertion;
@@ -45,23 +48,35 @@ struct node {
         struct node *right;
 };
 
-struct env {
-        struct node *root;
-};
-
 struct env *make_empty_env(void)
 {
-        struct env *rv = GC_malloc(sizeof *rv);
-        if (rv == NULL) enomem();
+        struct env *rv = alloc_object_of(ALLOC_ENV, sizeof *rv);
         rv->root = NULL;
+        rv->frame_n = 0;
+        rv->captured_n = 0;
+        return rv;
+}
+
+struct env *make_flat_env(size_t n, const char **names, struct datum **vals)
+{
+        struct env *rv = make_empty_env();
+        rv->captured_n = n;
+        rv->captured_names = names;
+        rv->captured_vals = vals;
         return rv;
 }
 
 bool env_lookup(struct env *env, const char *name, struct datum **out)
 {
+        for (size_t i = env->frame_n; i-- > 0; ) {
+                if (strcasecmp(name, env->frame_names[i]) == 0) {
+                        *out = env->frame_vals[i];
+                        return true;
+                }
+        }
         struct node *n = env->root;
         while (true) {
-                if (n == NULL) return false;
+                if (n == NULL) break;
                 int cmp = strcasecmp(name, n->name);
                 if (cmp > 0) {
                         n = n->right;
@@ -72,14 +87,20 @@ bool env_lookup(struct env *env, const char *name, struct datum **out)
                         return true;
                 }
         }
+        for (size_t i = 0; i < env->captured_n; i++) {
+                if (strcasecmp(name, env->captured_names[i]) == 0) {
+                        *out = env->captured_vals[i];
+                        return true;
+                }
+        }
+        return false;
 }
 
 static struct node *insert(struct node *n,
                            const char *name,
                            struct datum *binding)
 {
-        struct node *rv = GC_malloc(sizeof *rv);
-        if (rv == NULL) enomem();
+        struct node *rv = alloc_object_of(ALLOC_ENV, sizeof *rv);
         if (n == NULL) {
                 rv->name = name;
                 rv->binding = binding;
@@ -102,15 +123,125 @@ static struct node *insert(struct node *n,
         return rv;
 }
         
+/* Watches are kept in a small hash table keyed by the name, ignoring
+   case like the lookups, with one entry per specialization of a name
+   to a value that is still in force.  A watch holds its value only by
+   a weak reference, and leaves the table when it fires or when the
+   value has been collected; the code holding its flag keeps the rest
+   of it alive. */
+#define WATCH_BUCKETS 64
+
+struct watch {
+        const char *name;
+        uintptr_t value;        // a weak reference (alloc_weak_ref)
+        bool changed;
+        struct watch *next;
+};
+
+static struct watch *watches[WATCH_BUCKETS];
+static bool any_watches = false;
+
+static size_t watch_bucket(const char *name)
+{
+        size_t h = 5381;
+        for (const char *p = name; *p != '\0'; p++) {
+                h = h * 33 + (unsigned char)tolower((unsigned char)*p);
+        }
+        return h % WATCH_BUCKETS;
+}
+
+const bool *env_watch(const char *name, struct datum *value)
+{
+        size_t b = watch_bucket(name);
+        for (struct watch *w = watches[b]; w != NULL; w = w->next) {
+                if (alloc_weak_ref_is(w->value, value) &&
+                    strcasecmp(w->name, name) == 0) {
+                        return &w->changed;
+                }
+        }
+        struct watch *w = alloc_object(sizeof *w);
+        w->name = name;
+        alloc_weak_ref(&w->value, value);
+        w->changed = false;
+        w->next = watches[b];
+        watches[b] = w;
+        any_watches = true;
+        return &w->changed;
+}
+
+static void note_binding(const char *name, struct datum *binding)
+{
+        note_primop_binding(name, binding);
+        if (!any_watches) return;
+        struct watch **wp = &watches[watch_bucket(name)];
+        while (*wp != NULL) {
+                struct watch *w = *wp;
+                if (w->value == 0) {
+                        // nothing can be bound to the value any more
+                        *wp = w->next;
+                } else if (!alloc_weak_ref_is(w->value, binding) &&
+                           strcasecmp(w->name, name) == 0) {
+                        w->changed = true;
+                        *wp = w->next;
+                } else {
+                        wp = &w->next;
+                }
+        }
+}
+
 void env_bind(struct env *env, const char *name, struct datum *binding)
 {
+        assert(env->frame_n == 0);
+        note_binding(name, binding);
         env->root = insert(env->root, name, binding);
 }
 
 struct env *env_clone(struct env *env)
 {
-        struct env *rv = GC_malloc(sizeof *rv);
-        if (rv == NULL) enomem();
+        assert(env->frame_n == 0);
+        struct env *rv = alloc_object_of(ALLOC_ENV, sizeof *rv);
         rv->root = env->root;
+        rv->frame_n = 0;
+        rv->captured_n = env->captured_n;
+        rv->captured_names = env->captured_names;
+        rv->captured_vals = env->captured_vals;
         return rv;
 }
+
+void env_init_frame(struct env *env, struct env *base, size_t n,
+                    const char **names, struct datum **vals)
+{
+        assert(base->frame_n == 0);
+        env->root = base->root;
+        env->frame_n = n;
+        env->frame_names = names;
+        env->frame_vals = vals;
+        env->captured_n = base->captured_n;
+        env->captured_names = base->captured_names;
+        env->captured_vals = base->captured_vals;
+}
+
+void env_init_loop_frame(struct env *env, struct env *base, size_t n,
+                         const char **names, struct datum **vals)
+{
+        size_t k = base->frame_n;
+        const char **fnames = alloc_object_of(ALLOC_ENV,
+                                              (k + n) * sizeof *fnames);
+        struct datum **fvals = alloc_object_of(ALLOC_ENV,
+                                               (k + n) * sizeof *fvals);
+        for (size_t i = 0; i < k; i++) {
+                fnames[i] = base->frame_names[i];
+                fvals[i] = base->frame_vals[i];
+        }
+        for (size_t i = 0; i < n; i++) {
+                fnames[k + i] = names[i];
+                fvals[k + i] = vals[i];
+        }
+        env->root = base->root;
+        env->frame_n = k + n;
+        env->frame_names = fnames;
+        env->frame_vals = fvals;
+        env->captured_n = base->captured_n;
+        env->captured_names = base->captured_names;
+        env->captured_vals = base->captured_vals;
+}
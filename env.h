@@ -33,11 +33,32 @@
 #include <stdbool.h>
 #include "data.h"
 
-struct env;
+/* The layout is public only so that argument frames (see
+   env_init_frame) can be allocated by the caller; use the functions
+   below to access it. */
+struct env {
+        struct node *root;
+        // innermost bindings of an argument frame; frame_n == 0 if none
+        size_t frame_n;
+        const char **frame_names;
+        struct datum **frame_vals;
+        /* outermost bindings, captured by a converted closure (see
+           make_flat_env); captured_n == 0 if none */
+        size_t captured_n;
+        const char **captured_names;
+        struct datum **captured_vals;
+};
 
 /* Constructs a new, empty environment. */
 struct env *make_empty_env(void);
 
+/* Constructs an environment that binds only names[i] to vals[i].  It
+   is the environment of a closure converted to capture just its free
+   variables (see run_lambda in compile.c); the arrays are not copied.
+   Clones of it and frames on top of it share the arrays, and
+   bindings added to them with env_bind shadow the captured ones. */
+struct env *make_flat_env(size_t n, const char **names, struct datum **vals);
+
 /* Look up the value bound to this name.  If a value is found, returns
    true and assigns the value to *out.  If no value is found, returns
    false and does not touch *out.
@@ -47,9 +68,33 @@ bool env_lookup(struct env *, const char *name, struct datum **out);
 /* Binds the binding to the name.  Any previous binding is overwritten. */
 void env_bind(struct env *, const char *name, struct datum *binding);
 
+/* Registers a watch on the binding of name to value, made by code
+   specialized on the assumption that the name means that value (see
+   try_inline in compile.c).  The returned flag is set for good as soon
+   as env_bind binds the name, in any environment, to anything else.
+   value must be an object on the heap, such as a closure; the watch
+   does not keep it alive. */
+const bool *env_watch(const char *name, struct datum *value);
+
 /* Makes a clone of this environment.  The return value has the same
    bindings as the original, but subsequent modifications of either do
    not affect the other. */
 struct env *env_clone(struct env *);
 
+/* Initializes env (which may be in automatic storage) to the bindings
+   of base with names[i] bound to vals[i] on top, later names shadowing
+   earlier ones.  The arrays are not copied, and env_bind must not be
+   used on the result.  Unlike env_bind, this does not report the
+   bindings to note_primop_binding (primops.h); the names must be the
+   parameters of a parsed lambda, which the parser has reported. */
+void env_init_frame(struct env *env, struct env *base, size_t n,
+                    const char **names, struct datum **vals);
+
+/* Like env_init_frame, except that base may itself be a frame, whose
+   bindings are then kept under the new ones, and that the arrays are
+   copied into fresh ones.  The value of names[i] is afterwards
+   env->frame_vals[env->frame_n - n + i], which may be updated in place. */
+void env_init_loop_frame(struct env *env, struct env *base, size_t n,
+                         const char **names, struct datum **vals);
+
 #endif /* GUARD_ENV_H */
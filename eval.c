@@ -26,17 +26,179 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include "alloc.h"
 #include "ast.h"
+#include "compile.h"
 #include "error.h"
 #include "env.h"
 #include "eval.h"
 #include "primops.h"
+#include "printer.h"
+#include "timeline.h"
 
 
 static struct datum *eval_datum(struct datum *d, struct env *env);
 
+/* The argument stack.  Calls of closures whose abs_term has frame_args
+   set keep their arguments here instead of in a list and environment
+   nodes on the heap; the slots are cleared when the call returns so
+   that they do not keep garbage alive.  If the stack is full, calls
+   fall back to the heap.
+ */
+#define ARG_STACK_SIZE 65536
+
+static struct datum **arg_stack = NULL;
+static size_t arg_sp = 0;
+
+static bool arg_stack_reserve(size_t n)
+{
+        if (arg_stack == NULL) {
+                arg_stack = alloc_object(ARG_STACK_SIZE * sizeof *arg_stack);
+        }
+        return n <= ARG_STACK_SIZE - arg_sp;
+}
+
+static void arg_stack_pop_to(size_t sp)
+{
+        while (arg_sp > sp) arg_stack[--arg_sp] = NULL;
+}
+
+/* The calls in progress (see eval_trace_push in eval.h). */
+struct datum **eval_trace = NULL;
+size_t eval_trace_depth = 0;
+size_t eval_trace_max = 0;
+
+// backtraces list at most this many of the innermost calls
+#define BACKTRACE_LENGTH 20
+
+void eval_trace_grow(void)
+{
+        eval_trace_max = 2 * eval_trace_max + 64;
+        eval_trace = alloc_realloc(eval_trace,
+                                   eval_trace_max * sizeof *eval_trace);
+}
+
+static struct datum *capture_backtrace(void)
+{
+        struct datum *rv = make_NIL();
+        size_t n = eval_trace_depth < BACKTRACE_LENGTH
+                ? eval_trace_depth : BACKTRACE_LENGTH;
+        for (size_t i = eval_trace_depth - n; i < eval_trace_depth; i++) {
+                rv = make_pair(eval_trace[i], rv);
+        }
+        return rv;
+}
+
+/* Error handlers, innermost first.  Raising an error restores the
+   state saved in the handler and jumps to it. */
+struct handler {
+        jmp_buf jb;
+        struct handler *prev;
+        size_t arg_sp;
+        size_t trace_depth;
+        size_t timeline_depth;
+};
+
+static struct handler *handlers = NULL;
+static struct datum *raised = NULL;
+
+// set while an evaluation aborted by eval_poll unwinds to eval
+static bool aborting = false;
+
+void raise_error_value(struct datum *err)
+{
+        struct handler *h = handlers;
+        if (h == NULL) {
+                fputs("Uncaught error: ", stderr);
+                print_sexp(err, stderr);
+                fputc('\n', stderr);
+                exit(EXIT_FAILURE);
+        }
+        handlers = h->prev;
+        arg_stack_pop_to(h->arg_sp);
+        eval_trace_pop(h->trace_depth);
+        if (timeline_on) timeline_unwind(h->timeline_depth);
+        raised = err;
+        longjmp(h->jb, 1);
+}
+
+void raise_error(struct datum *where, const char *fmt, ...)
+{
+        va_list ap;
+        va_start(ap, fmt);
+        struct datum *err = make_error_va(where, fmt, ap);
+        va_end(ap);
+        set_error_backtrace(err, capture_backtrace());
+        raise_error_value(err);
+}
+
+struct datum *catch_errors(struct datum *(*fun)(void *), void *arg)
+{
+        struct handler h;
+        h.prev = handlers;
+        h.arg_sp = arg_sp;
+        h.trace_depth = eval_trace_depth;
+        h.timeline_depth = timeline_on ? timeline_depth() : 0;
+        handlers = &h;
+        if (setjmp(h.jb) != 0) {
+                // raise_error_value has already removed the handler
+                struct datum *err = raised;
+                raised = NULL;
+                if (aborting && handlers != NULL) raise_error_value(err);
+                return err;
+        }
+        struct datum *rv = fun(arg);
+        handlers = h.prev;
+        return rv;
+}
+
+/* Binds the parameters of the closure fun to the arguments in the
+   list arg, in a fresh copy of the closure's environment, which is
+   returned.  Raises an error if the arguments do not match the
+   parameters.
+ */
+static struct env *bind_args(struct datum *fun, struct abs_term *abs,
+                             struct datum *arg)
+{
+        struct env *env = env_clone(get_closure_env(fun));
+        struct datum *it = arg;
+        for (size_t i = 0; i < abs->num_params; i++) {
+                if (get_type(it) != T_PAIR) {
+                        raise_error(make_pair(fun, arg),
+                                    "Missing a parameter for %s",
+                                    abs->params[i]);
+                }
+                env_bind(env, abs->params[i], get_pair_first(it));
+                it = get_pair_second(it);
+        }
+        if (abs->rest_param_name != NULL) {
+                env_bind(env, abs->rest_param_name, it);
+        } else if (!is_NIL(it)) {
+                raise_error(make_pair(fun, arg), "Too many parameters");
+        }
+        return env;
+}
+
+// apply for a T_PRIMITIVE or T_CLOSURE, without recording the call
+static struct datum *apply_callable(struct datum *fun, struct datum *arg)
+{
+        if (get_type(fun) == T_PRIMITIVE) return apply_primitive(fun, arg);
+        if (get_closure_code(fun) != NULL) return code_apply(fun, arg);
+        struct abs_term *abs = term_as_abs_term(parse_sexp_as_term
+                                                (get_closure_fun(fun)));
+        return eval_datum(abs->body, bind_args(fun, abs, arg));
+}
+
 /* Applies the given function to the given argument.
 
    The function is assumed to be a fully evaluated datum, and the
@@ -51,67 +213,178 @@ static struct datum *apply(struct datum *fun,
                            struct datum *arg)
 {
         switch (get_type(fun)) {
-        case T_ERROR:
-                NOTREACHED;
-        case T_PAIR: case T_NUMBER: case T_SYMBOL:
-                return make_error(make_pair(fun, arg),
-                                  "ERROR: Cannot apply");
-        case T_PRIMITIVE:
-                return apply_primitive(fun, arg);
-        case T_CLOSURE:
-        {
-                struct env *env = env_clone(get_closure_env(fun));
-                struct abs_term *abs = term_as_abs_term(parse_sexp_as_term
-                                                        (get_closure_fun(fun)));
-                struct datum *it = arg;
-                for (size_t i = 0; i < abs->num_params; i++) {
-                        if (get_type(it) != T_PAIR) {
-                                return make_error(make_pair(fun, arg),
-                                                  "Missing a parameter for %s",
-                                                  abs->params[i]);
+        case T_PAIR: case T_NUMBER: case T_INTEGER: case T_SYMBOL:
+        case T_ERROR: case T_HASH: case T_F64VEC: case T_VECTOR:
+        case T_PROMISE:
+                raise_error(make_pair(fun, arg), "ERROR: Cannot apply");
+        case T_PRIMITIVE: case T_CLOSURE:
+                break;
+        }
+        if (!timeline_on) return apply_callable(fun, arg);
+        timeline_enter(fun);
+        struct datum *rv = apply_callable(fun, arg);
+        timeline_exit();
+        return rv;
+}
+
+/* Quickening.  The first time a call (f a) or (f a b) is evaluated,
+   if f is a variable bound to a primitive with a fast path, the call
+   is specialized: from then on, f is not looked up, the argument terms
+   are not parsed again and no argument list is built.  This holds only
+   while no program binds the name f (see note_primop_binding in
+   primops.h); once one does, the call goes back to the generic path
+   for good.  When the fast path does not apply to the operands, the
+   primitive is called in the ordinary way, so errors are unchanged.
+ */
+struct quick_app {
+        enum { QUICK_GENERIC, QUICK_PRIM } kind;
+        const _Bool *rebound;
+        prim_fun prim;
+        fast_fun fast;
+        size_t argc;
+        struct term *args[2];
+};
+
+static struct quick_app generic_app = { .kind = QUICK_GENERIC };
+
+static void quicken(struct term *t, struct env *env)
+{
+        struct app_term *at = term_as_app_term(t);
+        at->quick = &generic_app;
+        if (get_type(at->left) != T_SYMBOL) return;
+        const char *name = get_symbol_name(at->left);
+        const _Bool *rebound = get_primop_rebound_flag(name);
+        if (rebound == NULL || *rebound) return;
+        struct list_data ld = get_list_data(at->right);
+        fast_fun fast = get_primop_fast(name, ld.n);
+        struct datum *fun;
+        if (fast == NULL || !is_NIL(ld.terminator) ||
+            !env_lookup(env, name, &fun) ||
+            get_type(fun) != T_PRIMITIVE ||
+            get_primitive_fun(fun) != get_primop(name)) {
+                return;
+        }
+        struct quick_app *q = alloc_object(sizeof *q);
+        q->kind = QUICK_PRIM;
+        q->rebound = rebound;
+        q->prim = get_primitive_fun(fun);
+        q->fast = fast;
+        q->argc = ld.n;
+        for (size_t i = 0; i < ld.n; i++) {
+                q->args[i] = parse_sexp_as_term(ld.vec[i]);
+        }
+        alloc_keep_alive(ld.vec);
+        at->quick = q;
+}
+
+struct catch_args {
+        struct datum *body;
+        struct env *env;
+};
+
+static struct datum *eval_catch_body(void *p)
+{
+        struct catch_args *args = p;
+        return eval_datum(args->body, args->env);
+}
+
+/* Evaluates (DO ...).  When the loop cannot capture its environment,
+   the variables are bound in a single frame over env and updated in
+   place, so that iterating allocates nothing; otherwise each
+   iteration binds them afresh in a clone of env. */
+static struct datum *eval_loop(struct loop_term *lt, struct env *env)
+{
+        size_t n = lt->num_vars;
+        struct datum **vals = alloc_object_of(ALLOC_ARGS, n * sizeof *vals);
+        for (size_t i = 0; i < n; i++) {
+                vals[i] = eval_datum(lt->inits[i], env);
+        }
+        struct env frame;
+        struct env *lenv = &frame;
+        if (lt->frame_vars) {
+                env_init_loop_frame(&frame, env, n, lt->vars, vals);
+        }
+        while (true) {
+                eval_step();
+                if (!lt->frame_vars) {
+                        lenv = env_clone(env);
+                        for (size_t i = 0; i < n; i++) {
+                                env_bind(lenv, lt->vars[i], vals[i]);
+                        }
+                }
+                if (!is_NIL(eval_datum(lt->test, lenv))) break;
+                if (lt->body != NULL) eval_datum(lt->body, lenv);
+                // the steps see the old values, so the new ones are
+                // collected in vals first (a variable without a step
+                // keeps its initial value there)
+                for (size_t i = 0; i < n; i++) {
+                        if (lt->steps[i] != NULL) {
+                                vals[i] = eval_datum(lt->steps[i], lenv);
                         }
-                        env_bind(env, abs->params[i], get_pair_first(it));
-                        it = get_pair_second(it);
                 }
-                if (abs->rest_param_name != NULL) {
-                        env_bind(env, abs->rest_param_name, it);
-                } else if (!is_NIL(it)) {
-                        return make_error(make_pair(fun, arg),
-                                          "Too many parameters");
+                if (lt->frame_vars) {
+                        struct datum **cur = frame.frame_vals +
+                                frame.frame_n - n;
+                        for (size_t i = 0; i < n; i++) cur[i] = vals[i];
                 }
-                return eval_datum(abs->body, env);
-        }
         }
-        NOTREACHED;
+        return eval_datum(lt->result, lenv);
 }
 
+/* Records on the timeline the start of a tail call of fun made by
+   eval_term, which ends the call it made before, if timed.  Returns
+   the new value of timed. */
+static bool tail_call(bool timed, struct datum *fun)
+{
+        if (timed) timeline_exit();
+        timeline_enter(fun);
+        return true;
+}
 
 /*  Evaluates a Lisp term, which has already been parsed using
     parse_sexp_as_term (in ast.h and ast.c), in the environment given.
     The result is a Lisp datum representing the value of the term.
+
+    Terms in tail position (the chosen branch of a COND and the body
+    of an applied closure) are evaluated by the same invocation, in a
+    loop, so tail calls do not use up the C stack.
  */
 static struct datum *eval_term(struct term *t,
                                struct env *env)
 {
+        // argument frames of calls made here live above base; since
+        // every call made here is a tail call, the frame of the
+        // previous one can be reused by the next
+        size_t base = arg_sp;
+        // each call made here gets an entry in the trace above that of
+        // the call before, of which it is a tail call, except that
+        // past BACKTRACE_LENGTH of them the last entry is reused
+        size_t trace_base = eval_trace_depth;
+        size_t trace_top = trace_base;
+        // whether a call made here is open on the timeline
+        bool timed = false;
+        struct env frame;
+        struct datum *rv;
+        while (true) {
         switch (get_term_type(t)) {
         case TT_OTHER:
                 // TT_OTHER indicates that this is not a term as we
                 // understand it here
-                return make_error(get_original_sexp(t),
-                                  "ERROR: Cannot evaluate");
+                raise_error(get_original_sexp(t), "ERROR: Cannot evaluate");
         case TT_DATA:
                 // TT_DATA evaluates to itself
-                return get_original_sexp(t);
+                rv = get_original_sexp(t);
+                goto done;
         case TT_VAR:
                 // we look up the binding of the variable in the environment
         {
                 const char *name = term_as_var_term(t)->name;
-                struct datum *def;
-                if (!env_lookup(env, name, &def)) {
-                        return make_error(get_original_sexp(t),
-                                          "ERROR: Undefined variable");
+                if (!env_lookup(env, name, &rv)) {
+                        raise_error(get_original_sexp(t),
+                                    "ERROR: Undefined variable");
                 }
-                return def;
+                if (is_blackhole(rv)) raise_error_value(rv);
+                goto done;
         }
         case TT_APP:
                 // This is an application of the form (f a1 a2 ... an).
@@ -119,18 +392,76 @@ static struct datum *eval_term(struct term *t,
                 // arguments, and then call apply.
         {
                 struct app_term *at = term_as_app_term(t);
+                eval_step();
+                eval_trace_pop(trace_top);
+                eval_trace_push(get_original_sexp(t));
+                if (trace_top - trace_base < BACKTRACE_LENGTH - 1) trace_top++;
+                if (at->quick == NULL) quicken(t, env);
+                struct quick_app *q = at->quick;
+                // a call on the timeline takes the generic path, which
+                // records it
+                if (q->kind == QUICK_PRIM && !*q->rebound && !timeline_on) {
+                        struct datum *a = eval_term(q->args[0], env);
+                        struct datum *b = q->argc == 2
+                                ? eval_term(q->args[1], env)
+                                : NULL;
+                        rv = q->fast(a, b);
+                        if (rv == NULL) {
+                                struct datum *arg = make_NIL();
+                                if (b != NULL) arg = make_pair(b, arg);
+                                rv = q->prim(make_pair(a, arg));
+                        }
+                        goto done;
+                }
                 // evaluate function
                 struct datum *fun = eval_datum(at->left, env);
-                if (get_type(fun) == T_ERROR) return fun;
+                struct abs_term *abs = NULL;
+                if (get_type(fun) == T_CLOSURE &&
+                    get_closure_code(fun) == NULL) {
+                        abs = term_as_abs_term(parse_sexp_as_term
+                                               (get_closure_fun(fun)));
+                }
+                size_t n = 0;
+                struct datum *it;
+                for (it = at->right;
+                     get_type(it) == T_PAIR;
+                     it = get_pair_second(it)) {
+                        n++;
+                }
+                if (abs != NULL && abs->frame_args && is_NIL(it) &&
+                    n == abs->num_params && arg_stack_reserve(n)) {
+                        // The parameters cannot be captured, so the
+                        // arguments go in a frame on the argument stack.
+                        size_t top = arg_sp;
+                        arg_sp += n;
+                        size_t i = 0;
+                        for (it = at->right;
+                             get_type(it) == T_PAIR;
+                             it = get_pair_second(it)) {
+                                arg_stack[top + i++] =
+                                        eval_datum(get_pair_first(it), env);
+                        }
+                        memmove(arg_stack + base, arg_stack + top,
+                                n * sizeof *arg_stack);
+                        arg_stack_pop_to(base + n);
+                        env_init_frame(&frame, get_closure_env(fun), n,
+                                       abs->params, arg_stack + base);
+                        env = &frame;
+                        if (is_fixnum(abs->body)) {
+                                rv = abs->body;
+                                goto done;
+                        }
+                        t = parse_sexp_as_term(abs->body);
+                        if (timeline_on) timed = tail_call(timed, fun);
+                        continue;
+                }
                 // evaluate arguments
                 struct datum *arg = make_NIL();
                 struct datum *last = make_NIL();
-                struct datum *it;
                 for (it = at->right;
                      get_type(it) == T_PAIR;
                      it = get_pair_second(it)) {
                         struct datum *res = eval_datum(get_pair_first(it), env);
-                        if (get_type(res) == T_ERROR) return res;
                         struct datum *n = make_pair(res, make_NIL());
                         if (is_NIL(arg)) {
                                 assert(is_NIL(last));
@@ -147,14 +478,24 @@ static struct datum *eval_term(struct term *t,
                         // the terminator and construct the argument value
                         // list as improper too
                         struct datum *res = eval_datum(it, env);
-                        if (get_type(res) == T_ERROR) return res;
                         if (is_NIL(last)) {
                                 last = res;
                         } else {
                                 set_pair_second(last, res);
                         }
                 }
-                return apply(fun, arg);
+                if (abs == NULL) {
+                        rv = apply(fun, arg);
+                        goto done;
+                }
+                env = bind_args(fun, abs, arg);
+                if (is_fixnum(abs->body)) {
+                        rv = abs->body;
+                        goto done;
+                }
+                t = parse_sexp_as_term(abs->body);
+                if (timeline_on) timed = tail_call(timed, fun);
+                continue;
         }
         case TT_MU:
                 // recursion term (LABEL f ...).
@@ -167,11 +508,12 @@ static struct datum *eval_term(struct term *t,
         {
                 struct mu_term *mt = term_as_mu_term(t);
                 struct env *nenv = env_clone(env);
-                env_bind(nenv, mt->var, make_error(get_original_sexp(t),
-                                                   "Infinite recursion."));
-                struct datum *rv = eval_datum(mt->body, nenv);
+                env_bind(nenv, mt->var, make_blackhole(get_original_sexp(t),
+                                                       "Infinite recursion."));
+                rv = eval_datum(mt->body, nenv);
+                name_closure(rv, mt->var);
                 env_bind(nenv, mt->var, rv);
-                return rv;
+                goto done;
         }
         case TT_DEFINE:
                 // (DEFINE (x t) ... (x t))
@@ -183,17 +525,20 @@ static struct datum *eval_term(struct term *t,
                 struct define_term *dt = term_as_define_term(t);
                 // bind blackholes
                 for (struct define_term *it = dt; it != NULL; it = it->next) {
-                        env_bind(env, it->name, make_error(get_original_sexp(t),
-                                                           "Infinite recursion"
-                                                           " involving %s",
-                                                           it->name));
+                        env_bind(env, it->name,
+                                 make_blackhole(get_original_sexp(t),
+                                                "Infinite recursion"
+                                                " involving %s",
+                                                it->name));
                 }
                 // evaluate and re-bind the definitions
                 for (struct define_term *it = dt; it != NULL; it = it->next) {
                         struct datum *val = eval_datum(it->binding, env);
+                        name_closure(val, it->name);
                         env_bind(env, it->name, val);
                 }
-                return make_NIL();
+                rv = make_NIL();
+                goto done;
         }
 
         case TT_ABS:
@@ -204,35 +549,198 @@ static struct datum *eval_term(struct term *t,
                 // their values from here and not from the call site.
                 // This solves the environment (funarg) problem, and
                 // avoids variable capture.
-                return make_closure(get_original_sexp(t), env);
+                rv = make_closure(get_original_sexp(t), env);
+                goto done;
         case TT_GUARDED:
                 // (COND ...)
         {
                 struct guarded_term *gt = term_as_guarded_term(t);
-                do {
+                rv = make_NIL();
+                for (; gt != NULL; gt = gt->next) {
                         struct datum *test_result = eval_datum(gt->guard, env);
-                        if (!is_NIL(test_result)) {
-                                return eval_datum(gt->term, env);
-                        }
-                        gt = gt->next;
-                } while (gt != NULL);
-                return make_NIL();
+                        if (!is_NIL(test_result)) break;
+                }
+                if (gt == NULL) goto done;
+                if (is_fixnum(gt->term)) {
+                        rv = gt->term;
+                        goto done;
+                }
+                t = parse_sexp_as_term(gt->term);
+                continue;
         }
+        case TT_CATCH:
+                // (CATCH body): the value of body, or the error
+                // raised while evaluating it
+        {
+                struct catch_args args = {
+                        term_as_catch_term(t)->body, env
+                };
+                rv = catch_errors(eval_catch_body, &args);
+                goto done;
+        }
+        case TT_LOOP:
+                // (DO ((var init step) ...) (test result) body)
+                rv = eval_loop(term_as_loop_term(t), env);
+                goto done;
+        case TT_DELAY:
+                // (DELAY expr): a promise to apply a closure of no
+                // arguments, made here like that of a lambda
+                rv = make_promise(make_closure(term_as_delay_term(t)->lambda,
+                                               env),
+                                  make_NIL());
+                goto done;
         }
         NOTREACHED;
-}        
+        }
+done:
+        arg_stack_pop_to(base);
+        eval_trace_pop(trace_base);
+        if (timed) timeline_exit();
+        return rv;
+}
 
 /*  Evaluates a Lisp term, represented as S-expression data, in the
     environment given.  The result is a Lisp datum representing the
     value of the term.
+
+    A fixnum evaluates to itself and is not parsed, since
+    parse_sexp_as_term would allocate a fresh term for it every time.
+    eval_term checks for fixnums in tail position in the same way.
  */
 static struct datum *eval_datum(struct datum *d, struct env *env)
 {
+        if (is_fixnum(d)) return d;
         return eval_term(parse_sexp_as_term(d), env);
 }
-struct datum *eval(struct datum *d)
+
+/* Evaluation limits.  The engines count steps down in eval_countdown
+   (see eval_step), and eval_poll checks the limits and interrupts
+   when it runs out, which is every POLL_STEPS steps, or sooner if the
+   step limit is nearer than that.
+ */
+#define POLL_STEPS 4096
+
+long eval_countdown = POLL_STEPS;
+// the value eval_countdown was last set to
+static long period = POLL_STEPS;
+
+static unsigned long step_limit = 0, time_limit = 0;
+static size_t heap_limit = 0;
+
+// evaluations by eval in progress; the limits apply to the outermost
+static size_t eval_depth = 0;
+// the steps taken by it up to the last poll, and the state at its start
+static unsigned long steps;
+static size_t heap_at_start;
+static struct timespec time_at_start;
+
+static volatile sig_atomic_t interrupted = 0;
+
+void set_eval_limits(unsigned long s, size_t heap_growth, unsigned long ms)
+{
+        step_limit = s;
+        heap_limit = heap_growth;
+        time_limit = ms;
+}
+
+void eval_interrupt(void)
+{
+        interrupted = 1;
+}
+
+static void reset_countdown(void)
+{
+        period = POLL_STEPS;
+        if (eval_depth > 0 && step_limit != 0 && steps < step_limit &&
+            step_limit - steps < POLL_STEPS) {
+                period = (long)(step_limit - steps);
+        }
+        eval_countdown = period;
+}
+
+static unsigned long elapsed_ms(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (unsigned long)(ts.tv_sec - time_at_start.tv_sec) * 1000
+                + (unsigned long)(ts.tv_nsec / 1000000)
+                - (unsigned long)(time_at_start.tv_nsec / 1000000);
+}
+
+static void start_limits(void)
+{
+        steps = 0;
+        interrupted = 0;
+        if (heap_limit != 0) heap_at_start = alloc_heap_size();
+        if (time_limit != 0) clock_gettime(CLOCK_MONOTONIC, &time_at_start);
+        reset_countdown();
+}
+
+// raises an error that unwinds past every CATCH, up to eval
+static NORETURN(void abort_evaluation(const char *why));
+static void abort_evaluation(const char *why)
+{
+        aborting = true;
+        raise_error(make_NIL(), "%s", why);
+}
+
+void eval_poll(void)
+{
+        steps += (unsigned long)period;
+        if (interrupted) {
+                interrupted = 0;
+                abort_evaluation("Interrupted");
+        }
+        if (eval_depth > 0) {
+                if (step_limit != 0 && steps >= step_limit) {
+                        abort_evaluation("Step limit exceeded");
+                }
+                if (heap_limit != 0) {
+                        // the heap may have shrunk since the start
+                        size_t now = alloc_heap_size();
+                        if (now > heap_at_start
+                            && now - heap_at_start > heap_limit) {
+                                abort_evaluation("Heap limit exceeded");
+                        }
+                }
+                if (time_limit != 0 && elapsed_ms() >= time_limit) {
+                        abort_evaluation("Time limit exceeded");
+                }
+        }
+        reset_countdown();
+}
+
+static enum eval_engine engine = ENGINE_TREE;
+
+void set_eval_engine(enum eval_engine e)
+{
+        engine = e;
+}
+static struct datum *eval_top(void *d)
 {
         static struct env *global_env = NULL;
         if (global_env == NULL) global_env = get_primops_env();
-        return eval_datum(d, global_env);
+        return eval_in_env(d, global_env);
+}
+struct datum *eval(struct datum *d)
+{
+        if (eval_depth++ == 0) start_limits();
+        struct datum *rv = catch_errors(eval_top, d);
+        if (--eval_depth == 0) aborting = false;
+        return rv;
+}
+struct datum *eval_in_env(struct datum *d, struct env *env)
+{
+        switch (engine) {
+        case ENGINE_TREE:
+                return eval_datum(d, env);
+        case ENGINE_COMPILED:
+                return code_eval(d, env);
+        }
+        NOTREACHED;
+}
+struct datum *eval_apply(struct datum *fun, struct datum *arg)
+{
+        eval_step();
+        return apply(fun, arg);
 }
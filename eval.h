@@ -33,8 +33,92 @@
 
 /*  Evaluates a Lisp term, represented as S-expression data, in the
     global environment.  The result is a Lisp datum representing the
-    value of the term.
+    value of the term, or the error value if an error is raised and
+    not caught.
  */
 struct datum *eval(struct datum *);
 
+enum eval_engine {
+        ENGINE_TREE,     // walk the term tree (eval_term in eval.c)
+        ENGINE_COMPILED, // compile terms first (compile.h)
+};
+
+/*  Selects how eval and eval_in_env evaluate terms.  Closures are
+    always applied by the engine that created them.
+ */
+void set_eval_engine(enum eval_engine);
+
+/*  Evaluates a Lisp term, represented as S-expression data, in the
+    environment given.
+ */
+struct datum *eval_in_env(struct datum *, struct env *);
+
+/*  Applies a function value (a T_PRIMITIVE or a T_CLOSURE) to a list
+    of already evaluated arguments.
+ */
+struct datum *eval_apply(struct datum *fun, struct datum *arg);
+
+/*  Limits on each evaluation by eval: the number of steps (calls and
+    iterations of DO loops), the growth of the heap in bytes and the
+    wall time in milliseconds, where 0 means no limit.  An evaluation
+    that exceeds a limit is aborted with an error, which CATCH does not
+    catch; so is one during which eval_interrupt is called.
+ */
+void set_eval_limits(unsigned long steps, size_t heap_growth,
+                     unsigned long ms);
+
+/*  Requests that the evaluation in progress be aborted.  May be called
+    from a signal handler.
+ */
+void eval_interrupt(void);
+
+/*  Counts a step of evaluation, checking the limits and interrupts
+    every so many steps.  Called by both engines.
+ */
+extern long eval_countdown;
+void eval_poll(void);
+static inline void eval_step(void)
+{
+        if (--eval_countdown <= 0) eval_poll();
+}
+
+/*  The calls in progress, for backtraces: the applications being
+    evaluated, as S-expressions, innermost last.  Both engines record
+    a call with eval_trace_push before evaluating it, and remove it
+    when it returns by passing the depth that eval_trace_push returned
+    to eval_trace_pop.  Raising an error removes the calls it unwinds.
+ */
+extern struct datum **eval_trace;
+extern size_t eval_trace_depth, eval_trace_max;
+void eval_trace_grow(void);
+static inline size_t eval_trace_push(struct datum *call)
+{
+        size_t depth = eval_trace_depth;
+        if (depth == eval_trace_max) eval_trace_grow();
+        eval_trace[depth] = call;
+        eval_trace_depth = depth + 1;
+        return depth;
+}
+static inline void eval_trace_pop(size_t depth)
+{
+        eval_trace_depth = depth;
+}
+
+/*  Signals an error: unwinds to the innermost active handler (a CATCH
+    form, or eval), which returns the error value.  The message is
+    formatted only if it is needed (see make_error in data.h for the
+    restrictions on fmt), and the error records a backtrace of the
+    calls in progress.
+ */
+FORMAT(NORETURN(void raise_error(struct datum *where, const char *fmt,
+                                 ...)), printf, 2, 3);
+
+/*  Raises an existing error value again. */
+NORETURN(void raise_error_value(struct datum *));
+
+/*  Calls fun(arg) and returns its value, or the error value if an
+    error is raised and not caught during the call.
+ */
+struct datum *catch_errors(struct datum *(*fun)(void *), void *arg);
+
 #endif /* GUARD_EVAL_H */
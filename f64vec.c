@@ -0,0 +1,404 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include "f64vec.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define HAVE_X86_SIMD 1
+#  include <immintrin.h>
+#  define TARGET(isa) __attribute__((target(isa)))
+#endif
+
+typedef void binop(double *, const double *, const double *, size_t);
+
+struct kernels {
+        const char *name;
+        binop *add, *sub, *mul, *div;
+        void (*scale)(double *, const double *, double, size_t);
+        double (*dot)(const double *, const double *, size_t);
+        double (*sum)(const double *, size_t);
+        double (*min)(const double *, size_t);
+        double (*max)(const double *, size_t);
+        void (*prefix_sum)(double *, const double *, size_t);
+};
+
+/* Scalar versions; the vector versions use these for the elements
+   left over after the last full vector. */
+
+#define SCALAR_BINOP(name, op)                                          \
+        static void name##_scalar(double *r, const double *a,           \
+                                  const double *b, size_t n)            \
+        {                                                               \
+                for (size_t i = 0; i < n; i++) r[i] = a[i] op b[i];     \
+        }
+SCALAR_BINOP(add, +)
+SCALAR_BINOP(sub, -)
+SCALAR_BINOP(mul, *)
+SCALAR_BINOP(div, /)
+
+static void scale_scalar(double *r, const double *a, double k, size_t n)
+{
+        for (size_t i = 0; i < n; i++) r[i] = a[i] * k;
+}
+
+static double dot_scalar(const double *a, const double *b, size_t n)
+{
+        double s = 0;
+        for (size_t i = 0; i < n; i++) s += a[i] * b[i];
+        return s;
+}
+
+static double sum_scalar(const double *a, size_t n)
+{
+        double s = 0;
+        for (size_t i = 0; i < n; i++) s += a[i];
+        return s;
+}
+
+static double min_scalar(const double *a, size_t n)
+{
+        double m = a[0];
+        for (size_t i = 1; i < n; i++) if (a[i] < m) m = a[i];
+        return m;
+}
+
+static double max_scalar(const double *a, size_t n)
+{
+        double m = a[0];
+        for (size_t i = 1; i < n; i++) if (a[i] > m) m = a[i];
+        return m;
+}
+
+static void prefix_sum_scalar(double *r, const double *a, size_t n)
+{
+        double s = 0;
+        for (size_t i = 0; i < n; i++) r[i] = s += a[i];
+}
+
+static const struct kernels scalar_kernels = {
+        "scalar", add_scalar, sub_scalar, mul_scalar, div_scalar,
+        scale_scalar, dot_scalar, sum_scalar, min_scalar, max_scalar,
+        prefix_sum_scalar
+};
+
+#ifdef HAVE_X86_SIMD
+
+/* SSE2: two doubles per vector */
+
+#define SSE2_BINOP(name, intrinsic)                                     \
+        TARGET("sse2")                                                  \
+        static void name##_sse2(double *r, const double *a,             \
+                                const double *b, size_t n)              \
+        {                                                               \
+                size_t i = 0;                                           \
+                for (; i + 2 <= n; i += 2) {                            \
+                        _mm_store_pd(r + i, intrinsic(_mm_load_pd(a + i), \
+                                                      _mm_load_pd(b + i))); \
+                }                                                       \
+                name##_scalar(r + i, a + i, b + i, n - i);              \
+        }
+SSE2_BINOP(add, _mm_add_pd)
+SSE2_BINOP(sub, _mm_sub_pd)
+SSE2_BINOP(mul, _mm_mul_pd)
+SSE2_BINOP(div, _mm_div_pd)
+
+TARGET("sse2")
+static void scale_sse2(double *r, const double *a, double k, size_t n)
+{
+        __m128d kk = _mm_set1_pd(k);
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+                _mm_store_pd(r + i, _mm_mul_pd(_mm_load_pd(a + i), kk));
+        }
+        scale_scalar(r + i, a + i, k, n - i);
+}
+
+TARGET("sse2")
+static double hsum_sse2(__m128d x)
+{
+        return _mm_cvtsd_f64(_mm_add_sd(x, _mm_unpackhi_pd(x, x)));
+}
+
+TARGET("sse2")
+static double dot_sse2(const double *a, const double *b, size_t n)
+{
+        __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+                s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_load_pd(a + i),
+                                               _mm_load_pd(b + i)));
+                s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_load_pd(a + i + 2),
+                                               _mm_load_pd(b + i + 2)));
+        }
+        return hsum_sse2(_mm_add_pd(s0, s1)) + dot_scalar(a + i, b + i, n - i);
+}
+
+TARGET("sse2")
+static double sum_sse2(const double *a, size_t n)
+{
+        __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+                s0 = _mm_add_pd(s0, _mm_load_pd(a + i));
+                s1 = _mm_add_pd(s1, _mm_load_pd(a + i + 2));
+        }
+        return hsum_sse2(_mm_add_pd(s0, s1)) + sum_scalar(a + i, n - i);
+}
+
+#define SSE2_MINMAX(name, intrinsic)                                    \
+        TARGET("sse2")                                                  \
+        static double name##_sse2(const double *a, size_t n)            \
+        {                                                               \
+                if (n < 4) return name##_scalar(a, n);                  \
+                __m128d m = _mm_load_pd(a);                             \
+                size_t i = 2;                                           \
+                for (; i + 2 <= n; i += 2) {                            \
+                        m = intrinsic(m, _mm_load_pd(a + i));           \
+                }                                                       \
+                m = intrinsic(m, _mm_unpackhi_pd(m, m));                \
+                double rest[2] = { _mm_cvtsd_f64(m), 0 };               \
+                if (i < n) rest[1] = a[i];                              \
+                return name##_scalar(rest, i < n ? 2 : 1);              \
+        }
+SSE2_MINMAX(min, _mm_min_pd)
+SSE2_MINMAX(max, _mm_max_pd)
+
+TARGET("sse2")
+static void prefix_sum_sse2(double *r, const double *a, size_t n)
+{
+        __m128d zero = _mm_setzero_pd();
+        __m128d carry = zero;
+        size_t i = 0;
+        for (; i + 2 <= n; i += 2) {
+                __m128d x = _mm_load_pd(a + i);
+                // [x0, x1] + [0, x0]
+                x = _mm_add_pd(x, _mm_unpacklo_pd(zero, x));
+                x = _mm_add_pd(x, carry);
+                _mm_store_pd(r + i, x);
+                carry = _mm_unpackhi_pd(x, x);
+        }
+        if (i < n) r[i] = _mm_cvtsd_f64(carry) + a[i];
+}
+
+static const struct kernels sse2_kernels = {
+        "sse2", add_sse2, sub_sse2, mul_sse2, div_sse2,
+        scale_sse2, dot_sse2, sum_sse2, min_sse2, max_sse2,
+        prefix_sum_sse2
+};
+
+/* AVX2: four doubles per vector */
+
+#define AVX2_BINOP(name, intrinsic)                                     \
+        TARGET("avx2")                                                  \
+        static void name##_avx2(double *r, const double *a,             \
+                                const double *b, size_t n)              \
+        {                                                               \
+                size_t i = 0;                                           \
+                for (; i + 4 <= n; i += 4) {                            \
+                        _mm256_store_pd(r + i,                          \
+                                        intrinsic(_mm256_load_pd(a + i), \
+                                                  _mm256_load_pd(b + i))); \
+                }                                                       \
+                name##_scalar(r + i, a + i, b + i, n - i);              \
+        }
+AVX2_BINOP(add, _mm256_add_pd)
+AVX2_BINOP(sub, _mm256_sub_pd)
+AVX2_BINOP(mul, _mm256_mul_pd)
+AVX2_BINOP(div, _mm256_div_pd)
+
+TARGET("avx2")
+static void scale_avx2(double *r, const double *a, double k, size_t n)
+{
+        __m256d kk = _mm256_set1_pd(k);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+                _mm256_store_pd(r + i, _mm256_mul_pd(_mm256_load_pd(a + i),
+                                                     kk));
+        }
+        scale_scalar(r + i, a + i, k, n - i);
+}
+
+TARGET("avx2")
+static double hsum_avx2(__m256d x)
+{
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(x),
+                               _mm256_extractf128_pd(x, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+TARGET("avx2")
+static double dot_avx2(const double *a, const double *b, size_t n)
+{
+        __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+                s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_load_pd(a + i),
+                                                     _mm256_load_pd(b + i)));
+                s1 = _mm256_add_pd(s1,
+                                   _mm256_mul_pd(_mm256_load_pd(a + i + 4),
+                                                 _mm256_load_pd(b + i + 4)));
+        }
+        return hsum_avx2(_mm256_add_pd(s0, s1))
+                + dot_scalar(a + i, b + i, n - i);
+}
+
+TARGET("avx2")
+static double sum_avx2(const double *a, size_t n)
+{
+        __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+                s0 = _mm256_add_pd(s0, _mm256_load_pd(a + i));
+                s1 = _mm256_add_pd(s1, _mm256_load_pd(a + i + 4));
+        }
+        return hsum_avx2(_mm256_add_pd(s0, s1)) + sum_scalar(a + i, n - i);
+}
+
+#define AVX2_MINMAX(name, intrinsic, intrinsic128)                      \
+        TARGET("avx2")                                                  \
+        static double name##_avx2(const double *a, size_t n)            \
+        {                                                               \
+                if (n < 8) return name##_scalar(a, n);                  \
+                __m256d m = _mm256_load_pd(a);                          \
+                size_t i = 4;                                           \
+                for (; i + 4 <= n; i += 4) {                            \
+                        m = intrinsic(m, _mm256_load_pd(a + i));        \
+                }                                                       \
+                __m128d h = intrinsic128(_mm256_castpd256_pd128(m),     \
+                                         _mm256_extractf128_pd(m, 1));  \
+                h = intrinsic128(h, _mm_unpackhi_pd(h, h));             \
+                double rest[4] = { _mm_cvtsd_f64(h) };                  \
+                size_t k = 1;                                           \
+                for (; i < n; i++) rest[k++] = a[i];                    \
+                return name##_scalar(rest, k);                          \
+        }
+AVX2_MINMAX(min, _mm256_min_pd, _mm_min_pd)
+AVX2_MINMAX(max, _mm256_max_pd, _mm_max_pd)
+
+TARGET("avx2")
+static void prefix_sum_avx2(double *r, const double *a, size_t n)
+{
+        __m256d zero = _mm256_setzero_pd();
+        __m256d carry = zero;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+                __m256d x = _mm256_load_pd(a + i);
+                // [x0, x1, x2, x3] + [0, x0, x1, x2]
+                x = _mm256_add_pd(x, _mm256_blend_pd(
+                        _mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)),
+                        zero, 0x1));
+                // + [0, 0, s0, s1]
+                x = _mm256_add_pd(x, _mm256_blend_pd(
+                        _mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)),
+                        zero, 0x3));
+                x = _mm256_add_pd(x, carry);
+                _mm256_store_pd(r + i, x);
+                carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+        }
+        double s = _mm256_cvtsd_f64(carry);
+        for (; i < n; i++) r[i] = s += a[i];
+}
+
+static const struct kernels avx2_kernels = {
+        "avx2", add_avx2, sub_avx2, mul_avx2, div_avx2,
+        scale_avx2, dot_avx2, sum_avx2, min_avx2, max_avx2,
+        prefix_sum_avx2
+};
+
+#endif /* HAVE_X86_SIMD */
+
+static const struct kernels *kernels(void)
+{
+        static const struct kernels *k = NULL;
+        if (k != NULL) return k;
+        k = &scalar_kernels;
+#ifdef HAVE_X86_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+                k = &avx2_kernels;
+        } else if (__builtin_cpu_supports("sse2")) {
+                k = &sse2_kernels;
+        }
+#endif
+        return k;
+}
+
+void f64_add(double *r, const double *a, const double *b, size_t n)
+{
+        kernels()->add(r, a, b, n);
+}
+
+void f64_sub(double *r, const double *a, const double *b, size_t n)
+{
+        kernels()->sub(r, a, b, n);
+}
+
+void f64_mul(double *r, const double *a, const double *b, size_t n)
+{
+        kernels()->mul(r, a, b, n);
+}
+
+void f64_div(double *r, const double *a, const double *b, size_t n)
+{
+        kernels()->div(r, a, b, n);
+}
+
+void f64_scale(double *r, const double *a, double k, size_t n)
+{
+        kernels()->scale(r, a, k, n);
+}
+
+double f64_dot(const double *a, const double *b, size_t n)
+{
+        return kernels()->dot(a, b, n);
+}
+
+double f64_sum(const double *a, size_t n)
+{
+        return kernels()->sum(a, n);
+}
+
+double f64_min(const double *a, size_t n)
+{
+        return kernels()->min(a, n);
+}
+
+double f64_max(const double *a, size_t n)
+{
+        return kernels()->max(a, n);
+}
+
+void f64_prefix_sum(double *r, const double *a, size_t n)
+{
+        kernels()->prefix_sum(r, a, n);
+}
+
+const char *f64_kernel_name(void)
+{
+        return kernels()->name;
+}
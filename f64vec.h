@@ -0,0 +1,60 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+ 
+#ifndef GUARD_F64VEC_H
+#define GUARD_F64VEC_H
+
+#include <stddef.h>
+
+/* Numeric kernels over packed arrays of doubles, the contents of
+   T_F64VEC data.  On x86 they use AVX2 or SSE2, chosen at the first
+   call according to what the processor supports; elsewhere, and on
+   processors without either, plain C loops are used.  The reductions
+   accumulate in several lanes at once, so their results may differ
+   from a left-to-right sum in the last bits.
+
+   Arrays are 32-byte aligned (see make_f64vec in data.h); the result
+   of an element-wise operation may be the same array as an operand. */
+
+void f64_add(double *r, const double *a, const double *b, size_t n);
+void f64_sub(double *r, const double *a, const double *b, size_t n);
+void f64_mul(double *r, const double *a, const double *b, size_t n);
+void f64_div(double *r, const double *a, const double *b, size_t n);
+void f64_scale(double *r, const double *a, double k, size_t n);
+double f64_dot(const double *a, const double *b, size_t n);
+double f64_sum(const double *a, size_t n);
+// n must not be zero
+double f64_min(const double *a, size_t n);
+double f64_max(const double *a, size_t n);
+// r[i] = a[0] + ... + a[i]
+void f64_prefix_sum(double *r, const double *a, size_t n);
+
+// "avx2", "sse2" or "scalar"
+const char *f64_kernel_name(void);
+
+#endif /* GUARD_F64VEC_H */
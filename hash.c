@@ -0,0 +1,292 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "data.h"
+#include "hash.h"
+#include "pvec.h"
+
+#define MIN_CAPACITY 8
+// old buckets moved to the new array per operation while growing
+#define MIGRATE_STEP 16
+// how much of a structured key hash_datum looks at
+#define HASH_PAIR_BUDGET 64
+#define HASH_STACK_SIZE 16
+
+struct entry {
+        uint64_t hash;
+        struct datum *key;      // NULL if empty
+        struct datum *value;
+};
+
+struct table {
+        struct entry *entries;
+        size_t cap;             // a power of two
+        size_t used;            // live and deleted entries
+};
+
+struct hash {
+        struct table cur;
+        struct table old;       // being moved into cur, if entries != NULL
+        size_t migrated;        // old buckets before this have been moved
+        size_t count;
+};
+
+// marks a deleted entry, so that probing goes on past it
+static char deleted_key;
+#define DELETED ((struct datum *)&deleted_key)
+
+static uint64_t mix(uint64_t h, uint64_t x)
+{
+        h = (h ^ x) * UINT64_C(0x9e3779b97f4a7c15);
+        return h ^ (h >> 29);
+}
+
+static uint64_t hash_atom(struct datum *d)
+{
+        switch (get_type(d)) {
+        case T_NUMBER: case T_INTEGER:
+        {
+                // equal numbers of different types must hash alike
+                double v = get_numeric_value(d);
+                uint64_t bits;
+                if (v == 0) v = 0;      // -0.0
+                memcpy(&bits, &v, sizeof bits);
+                return mix(1, bits);
+        }
+        case T_SYMBOL:
+        {
+                // symbols are compared ignoring case
+                uint64_t h = 2;
+                for (const char *s = get_symbol_name(d); *s != '\0'; s++) {
+                        h = mix(h, tolower((unsigned char)*s));
+                }
+                return h;
+        }
+        default:
+                return mix(3, (uintptr_t)d);
+        }
+}
+
+uint64_t hash_datum(struct datum *d)
+{
+        // Walks cars first, remembering cdrs on a small stack; cdrs
+        // that do not fit, and everything past the budget, are left
+        // out.  Vector elements count against the same budget, the
+        // atomic ones mixed in directly and the others stacked like
+        // cdrs.  Since the walk depends only on the structure, equal
+        // data still hash alike.
+        struct datum *stack[HASH_STACK_SIZE];
+        size_t n = 0;
+        size_t budget = HASH_PAIR_BUDGET;
+        uint64_t h = 0;
+        for (;;) {
+                while (get_type(d) == T_PAIR && budget > 0) {
+                        budget--;
+                        h = mix(h, 4);
+                        if (n < HASH_STACK_SIZE) stack[n++] = get_pair_second(d);
+                        d = get_pair_first(d);
+                }
+                if (get_type(d) == T_VECTOR) {
+                        struct pvec *v = get_vector(d);
+                        size_t len = pvec_length(v);
+                        h = mix(h, mix(5, len));
+                        for (size_t i = 0; i < len && budget > 0; i++) {
+                                struct datum *e = pvec_ref(v, i);
+                                budget--;
+                                if (get_type(e) != T_PAIR
+                                    && get_type(e) != T_VECTOR) {
+                                        h = mix(h, hash_atom(e));
+                                } else if (n < HASH_STACK_SIZE) {
+                                        stack[n++] = e;
+                                }
+                        }
+                } else {
+                        h = mix(h, get_type(d) == T_PAIR ? 4 : hash_atom(d));
+                }
+                if (n == 0 || budget == 0) return h;
+                d = stack[--n];
+        }
+}
+
+static void table_init(struct table *t, size_t cap)
+{
+        t->entries = alloc_object(cap * sizeof *t->entries);
+        t->cap = cap;
+        t->used = 0;
+}
+
+/* Probes only the buckets from lo on, wrapping around to lo.  In the
+   old array of a growing table, the buckets before lo have been moved
+   and emptied, and every entry left is reachable this way because its
+   probe sequence ran through occupied buckets only. */
+static struct entry *table_find(struct table *t, size_t lo, uint64_t h,
+                                struct datum *key)
+{
+        size_t i = h & (t->cap - 1);
+        if (i < lo) i = lo;
+        for (size_t n = t->cap - lo; n > 0; n--) {
+                struct entry *e = &t->entries[i];
+                if (e->key == NULL) return NULL;
+                if (e->hash == h && e->key != DELETED) {
+                        if (e->key == key) return e;
+                        // data_equal allocates, and e may be all that
+                        // is left of the array
+                        bool same = data_equal(e->key, key);
+                        alloc_keep_alive(t->entries);
+                        if (same) return e;
+                }
+                if (++i == t->cap) i = lo;
+        }
+        return NULL;
+}
+
+// key must not be in the table
+static void table_insert(struct table *t, uint64_t h, struct datum *key,
+                         struct datum *value)
+{
+        size_t mask = t->cap - 1;
+        size_t i = h & mask;
+        while (t->entries[i].key != NULL) i = (i + 1) & mask;
+        t->entries[i] = (struct entry) { h, key, value };
+        t->used++;
+}
+
+static void migrate(struct hash *ht, size_t steps)
+{
+        if (ht->old.entries == NULL) return;
+        while (steps-- > 0 && ht->migrated < ht->old.cap) {
+                struct entry *e = &ht->old.entries[ht->migrated++];
+                if (e->key != NULL && e->key != DELETED) {
+                        table_insert(&ht->cur, e->hash, e->key, e->value);
+                }
+                e->key = NULL;
+                e->value = NULL;
+        }
+        if (ht->migrated == ht->old.cap) {
+                ht->old.entries = NULL;
+                ht->old.cap = 0;
+        }
+}
+
+static void grow(struct hash *ht)
+{
+        migrate(ht, SIZE_MAX);
+        size_t cap = ht->cur.cap;
+        while (2 * (ht->count + 1) > cap) cap *= 2;
+        ht->old = ht->cur;
+        ht->migrated = 0;
+        table_init(&ht->cur, cap);
+}
+
+struct hash *hash_new(void)
+{
+        struct hash *ht = alloc_object(sizeof *ht);
+        table_init(&ht->cur, MIN_CAPACITY);
+        return ht;
+}
+
+size_t hash_count(const struct hash *ht)
+{
+        return ht->count;
+}
+
+static struct entry *find(struct hash *ht, uint64_t h, struct datum *key,
+                          struct table **where)
+{
+        migrate(ht, MIGRATE_STEP);
+        struct entry *e = table_find(&ht->cur, 0, h, key);
+        *where = &ht->cur;
+        if (e == NULL && ht->old.entries != NULL) {
+                e = table_find(&ht->old, ht->migrated, h, key);
+                *where = &ht->old;
+        }
+        return e;
+}
+
+struct datum *hash_get(struct hash *ht, struct datum *key)
+{
+        struct table *t;
+        struct entry *e = find(ht, hash_datum(key), key, &t);
+        return e != NULL ? e->value : NULL;
+}
+
+void hash_put(struct hash *ht, struct datum *key, struct datum *value)
+{
+        uint64_t h = hash_datum(key);
+        struct table *t;
+        struct entry *e = find(ht, h, key, &t);
+        if (e != NULL && t == &ht->cur) {
+                e->value = value;
+                return;
+        }
+        if (e != NULL) {
+                // new bindings go to the new array only
+                e->key = DELETED;
+                e->value = NULL;
+                ht->count--;
+        }
+        if (4 * (ht->cur.used + 1) > 3 * ht->cur.cap) grow(ht);
+        table_insert(&ht->cur, h, key, value);
+        ht->count++;
+}
+
+bool hash_del(struct hash *ht, struct datum *key)
+{
+        struct table *t;
+        struct entry *e = find(ht, hash_datum(key), key, &t);
+        if (e == NULL) return false;
+        e->key = DELETED;
+        e->value = NULL;
+        ht->count--;
+        return true;
+}
+
+static void table_for_each(struct table *t,
+                           void (*fun)(struct datum *, struct datum *, void *),
+                           void *arg)
+{
+        for (size_t i = 0; i < t->cap; i++) {
+                struct entry *e = &t->entries[i];
+                if (e->key != NULL && e->key != DELETED) {
+                        fun(e->key, e->value, arg);
+                }
+        }
+        alloc_keep_alive(t->entries);
+}
+
+void hash_for_each(struct hash *ht,
+                   void (*fun)(struct datum *, struct datum *, void *),
+                   void *arg)
+{
+        table_for_each(&ht->cur, fun, arg);
+        if (ht->old.entries != NULL) table_for_each(&ht->old, fun, arg);
+}
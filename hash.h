@@ -0,0 +1,73 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+ 
+#ifndef GUARD_HASH_H
+#define GUARD_HASH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct datum;
+
+/* Mutable hash tables keyed by data under data_equal (see data.h):
+   numbers by value, symbols by name and pairs by structure.
+
+   The table is open-addressed with linear probing over one contiguous
+   array of entries that carry their hash, so that a lookup usually
+   touches one cache line and calls data_equal only on a real match.
+   Growing does not rehash everything at once: the old array is kept
+   beside the new one and a few of its buckets are moved over on every
+   operation, so no single operation takes time proportional to the
+   size of the table. */
+struct hash;
+
+struct hash *hash_new(void);
+
+size_t hash_count(const struct hash *);
+
+/* Returns the value bound to key, or NULL if there is none. */
+struct datum *hash_get(struct hash *, struct datum *key);
+
+void hash_put(struct hash *, struct datum *key, struct datum *value);
+
+/* Returns false if key was not bound. */
+bool hash_del(struct hash *, struct datum *key);
+
+/* Calls fun on every binding, in no particular order.  fun must not
+   modify the table. */
+void hash_for_each(struct hash *,
+                   void (*fun)(struct datum *key, struct datum *value,
+                               void *arg),
+                   void *arg);
+
+/* The hash of a datum, consistent with data_equal.  Only a bounded
+   prefix of a large structure is looked at. */
+uint64_t hash_datum(struct datum *);
+
+#endif /* GUARD_HASH_H */
@@ -0,0 +1,245 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "data.h"
+#include "heap_profile.h"
+#include "primops.h"
+#include "timeline.h"
+
+struct site {
+        // a closure, or primitive, name; or NULL at the top level
+        const char *name;
+        prim_fun prim;
+        enum alloc_kind kind;
+        uint64_t count, bytes;
+        uint64_t live_count, live_bytes;   // filled in by the report
+};
+
+#define NO_SITE SIZE_MAX
+
+/* A sampled object, in use if site is not NO_SITE.  Free slots are
+   linked through next. */
+struct slot {
+        uintptr_t ref;          // a weak reference to the object
+        size_t site;
+        size_t size;
+        unsigned long collections;  // alloc_collections() at allocation
+        size_t next;
+};
+
+#define SLOT_CHUNK 4096
+
+_Bool heap_profile_on = 0;
+
+static unsigned long sample;
+
+static struct site *sites = NULL;
+static size_t num_sites = 0, sites_max = 0;
+// indices into sites + 1, or 0 for none, by site_hash
+static size_t *site_table = NULL;
+static size_t site_mask = 0;
+
+// the slots, in chunks of SLOT_CHUNK that never move (the collector
+// writes to the weak references in them)
+static struct slot **chunks = NULL;
+static size_t num_chunks = 0;
+static size_t free_slot = NO_SITE;
+static unsigned long reclaimed_at = 0;
+
+static struct slot *slot_at(size_t i)
+{
+        return &chunks[i / SLOT_CHUNK][i % SLOT_CHUNK];
+}
+
+static size_t site_hash(const char *name, prim_fun prim,
+                        enum alloc_kind kind)
+{
+        uintptr_t h = (uintptr_t)name ^ (uintptr_t)prim;
+        return (size_t)((h >> 3) * 31 + kind) & site_mask;
+}
+
+static void grow_site_table(void)
+{
+        site_mask = site_mask == 0 ? 63 : 2 * site_mask + 1;
+        site_table = alloc_atomic((site_mask + 1) * sizeof *site_table);
+        memset(site_table, 0, (site_mask + 1) * sizeof *site_table);
+        for (size_t i = 0; i < num_sites; i++) {
+                size_t h = site_hash(sites[i].name, sites[i].prim,
+                                     sites[i].kind);
+                while (site_table[h] != 0) h = (h + 1) & site_mask;
+                site_table[h] = i + 1;
+        }
+}
+
+static size_t find_site(const char *name, prim_fun prim,
+                        enum alloc_kind kind)
+{
+        size_t h = site_hash(name, prim, kind);
+        for (; site_table[h] != 0; h = (h + 1) & site_mask) {
+                struct site *s = &sites[site_table[h] - 1];
+                if (s->name == name && s->prim == prim && s->kind == kind) {
+                        return site_table[h] - 1;
+                }
+        }
+        if (num_sites == sites_max) {
+                sites_max = 2 * sites_max + 64;
+                sites = alloc_realloc(sites, sites_max * sizeof *sites);
+        }
+        struct site *s = &sites[num_sites];
+        s->name = name;
+        s->prim = prim;
+        s->kind = kind;
+        s->count = s->bytes = 0;
+        site_table[h] = ++num_sites;
+        if (2 * num_sites > site_mask) grow_site_table();
+        return num_sites - 1;
+}
+
+/* Returns the index of a free slot.  The slots of sampled objects
+   that have been collected are reclaimed once per collection. */
+static size_t new_slot(void)
+{
+        if (free_slot == NO_SITE && alloc_collections() != reclaimed_at) {
+                reclaimed_at = alloc_collections();
+                for (size_t i = 0; i < num_chunks * SLOT_CHUNK; i++) {
+                        struct slot *s = slot_at(i);
+                        if (s->site != NO_SITE && s->ref == 0) {
+                                s->site = NO_SITE;
+                                s->next = free_slot;
+                                free_slot = i;
+                        }
+                }
+        }
+        if (free_slot == NO_SITE) {
+                chunks = alloc_realloc(chunks,
+                                       (num_chunks + 1) * sizeof *chunks);
+                struct slot *c = alloc_atomic(SLOT_CHUNK * sizeof *c);
+                chunks[num_chunks] = c;
+                size_t base = num_chunks++ * SLOT_CHUNK;
+                for (size_t i = SLOT_CHUNK; i-- > 0; ) {
+                        c[i].site = NO_SITE;
+                        c[i].next = free_slot;
+                        free_slot = base + i;
+                }
+        }
+        size_t rv = free_slot;
+        free_slot = slot_at(rv)->next;
+        return rv;
+}
+
+static void sampled(enum alloc_kind kind, void *obj, size_t size)
+{
+        const char *name = NULL;
+        prim_fun prim = NULL;
+        struct datum *fun = timeline_current();
+        if (fun != NULL && get_type(fun) == T_PRIMITIVE) {
+                prim = get_primitive_fun(fun);
+        } else if (fun != NULL) {
+                name = get_closure_name(fun);
+                if (name == NULL) name = "LAMBDA";
+        }
+        size_t i = find_site(name, prim, kind);
+        sites[i].count++;
+        sites[i].bytes += size;
+        struct slot *s = slot_at(new_slot());
+        s->site = i;
+        s->size = size;
+        s->collections = alloc_collections();
+        alloc_weak_ref(&s->ref, obj);
+}
+
+static int by_bytes(const void *a, const void *b)
+{
+        const struct site *x = a, *y = b;
+        if (x->bytes != y->bytes) return x->bytes < y->bytes ? 1 : -1;
+        return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+void heap_profile_print(FILE *fp)
+{
+        // objects are counted as live if they survived the last
+        // collection
+        unsigned long gcs = alloc_collections();
+        size_t n = num_sites;
+        for (size_t i = 0; i < n; i++) {
+                sites[i].live_count = sites[i].live_bytes = 0;
+        }
+        for (size_t i = 0; i < num_chunks * SLOT_CHUNK; i++) {
+                struct slot *s = slot_at(i);
+                if (s->site == NO_SITE || s->ref == 0 ||
+                    s->collections == gcs) {
+                        continue;
+                }
+                sites[s->site].live_count++;
+                sites[s->site].live_bytes += s->size;
+        }
+        // (sites may grow, by sampling, while this is allocated)
+        struct site *sorted = alloc_object((n + 1) * sizeof *sorted);
+        memcpy(sorted, sites, n * sizeof *sorted);
+        qsort(sorted, n, sizeof *sorted, by_bytes);
+
+        fprintf(fp, "Heap profile: 1 in %lu allocations sampled, "
+                "%lu collections, heap size %zu bytes\n",
+                sample, gcs, alloc_heap_size());
+        fprintf(fp, "%14s %12s %14s %12s  %-8s %s\n",
+                "bytes", "count", "live bytes", "live count",
+                "kind", "function");
+        for (size_t i = 0; i < n; i++) {
+                struct site *s = &sorted[i];
+                const char *name = s->name;
+                if (s->prim != NULL) name = get_primop_name(s->prim);
+                if (s->prim != NULL && name == NULL) name = "#<primitive>";
+                if (name == NULL) name = "(top level)";
+                fprintf(fp, "%14llu %12llu %14llu %12llu  %-8s %s\n",
+                        (unsigned long long)(s->bytes * sample),
+                        (unsigned long long)(s->count * sample),
+                        (unsigned long long)(s->live_bytes * sample),
+                        (unsigned long long)(s->live_count * sample),
+                        alloc_kind_name(s->kind), name);
+        }
+        fflush(fp);
+}
+
+static void print_at_exit(void)
+{
+        heap_profile_print(stderr);
+}
+
+void heap_profile_start(unsigned long s)
+{
+        sample = s > 0 ? s : 1;
+        grow_site_table();
+        timeline_track();
+        alloc_on_sample(sampled, sample);
+        atexit(print_at_exit);
+        heap_profile_on = 1;
+}
@@ -0,0 +1,53 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#ifndef GUARD_HEAP_PROFILE_H
+#define GUARD_HEAP_PROFILE_H
+
+#include <stdio.h>
+
+/* A profile of allocations by site, that is, by the function whose
+   call was innermost (see timeline_current in timeline.h) and by the
+   kind of the object (see enum alloc_kind in alloc.h).  One allocation
+   in sample is recorded, and the figures reported are scaled up by
+   sample.  The sampled objects are followed with weak references, so
+   that the report can also estimate how much of each site's
+   allocation was still live at the last collection.
+ */
+
+// set by heap_profile_start
+extern _Bool heap_profile_on;
+
+/* Starts profiling, with a report written to the standard error at
+   exit. */
+void heap_profile_start(unsigned long sample);
+
+/* Writes the report of the allocations so far to fp. */
+void heap_profile_print(FILE *fp);
+
+#endif /* GUARD_HEAP_PROFILE_H */
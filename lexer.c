@@ -27,96 +27,267 @@
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
 #include <ctype.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <unistd.h>
+#include "bignum.h"
 #include "data.h"
-#include "y.tab.h"
+#include "error.h"
 #include "lexer.h"
 
-enum { UNDETERMINED, NOTTY, TTY } input_type = UNDETERMINED;
-static char *line = NULL;
-static size_t line_len = 0;
-static size_t line_inx = 0;
-static size_t open_parens = 0;
+#define CHUNK_SIZE 65536
 
-int yylex(void)
+enum source { SRC_FILE, SRC_READLINE, SRC_STRING };
+
+struct lexer {
+        enum source source;
+        FILE *fp;
+        const char *name;
+        const char *text;       /* the buffer being scanned */
+        char *buf;              /* owned storage behind text, if any */
+        size_t cap;
+        size_t len;
+        size_t inx;
+        bool eof;
+        size_t line, col;       /* position of text[inx] */
+        size_t tok_line, tok_col;
+        size_t open_parens;
+};
+
+static struct lexer *new_lexer(enum source source, const char *name)
 {
-        if (input_type == UNDETERMINED) {
-                if (isatty(STDIN_FILENO)) {
-                        input_type = TTY;
-                        return INTERACTIVE;
-                } else {
-                        input_type = NOTTY;
-                        return NONINTERACTIVE;
+        struct lexer *lx = calloc(1, sizeof *lx);
+        if (lx == NULL) enomem();
+        lx->source = source;
+        lx->name = name;
+        lx->text = "";
+        lx->line = lx->col = 1;
+        return lx;
+}
+
+struct lexer *lexer_new_file(FILE *fp, const char *name)
+{
+        struct lexer *lx = new_lexer(SRC_FILE, name);
+        lx->fp = fp;
+        return lx;
+}
+
+struct lexer *lexer_new_readline(void)
+{
+        return new_lexer(SRC_READLINE, "<stdin>");
+}
+
+struct lexer *lexer_new_string(const char *s, size_t len, const char *name)
+{
+        struct lexer *lx = new_lexer(SRC_STRING, name);
+        lx->text = s;
+        lx->len = len;
+        lx->eof = true;
+        return lx;
+}
+
+void lexer_free(struct lexer *lx)
+{
+        free(lx->buf);
+        free(lx);
+}
+
+struct lexer *standard_input(void)
+{
+        static struct lexer *lx = NULL;
+        if (lx == NULL) {
+                lx = isatty(STDIN_FILENO)
+                        ? lexer_new_readline()
+                        : lexer_new_file(stdin, "<stdin>");
+        }
+        return lx;
+}
+
+static void reserve(struct lexer *lx, size_t n)
+{
+        if (n <= lx->cap) return;
+        size_t cap = lx->cap > 0 ? lx->cap : CHUNK_SIZE;
+        while (cap < n) cap *= 2;
+        char *buf = realloc(lx->buf, cap);
+        if (buf == NULL) enomem();
+        lx->buf = buf;
+        lx->cap = cap;
+}
+
+/* Reads more input after text[len].  The characters before text[keep]
+   are no longer needed and may be discarded, so that the buffer only
+   ever holds the token being scanned plus one chunk.  Returns false at
+   end of input. */
+static bool refill(struct lexer *lx, size_t keep)
+{
+        if (lx->eof) return false;
+        size_t rest = lx->len - keep;
+        if (rest > 0) memmove(lx->buf, lx->buf + keep, rest);
+        lx->len = rest;
+        lx->inx -= keep;
+        if (lx->source == SRC_READLINE) {
+                char *line = readline(lx->open_parens > 0 ? ": " : "> ");
+                if (line == NULL) {
+                        lx->eof = true;
+                        return false;
                 }
-                
+                size_t n = strlen(line);
+                reserve(lx, rest + n + 1);
+                memcpy(lx->buf + rest, line, n);
+                lx->buf[rest + n] = '\n';
+                lx->len += n + 1;
+                free(line);
+        } else {
+                reserve(lx, rest + CHUNK_SIZE);
+                size_t n = fread(lx->buf + rest, 1, lx->cap - rest, lx->fp);
+                if (ferror(lx->fp)) {
+                        fprintf(stderr, "%s: Input error.\n", lx->name);
+                        exit(EXIT_FAILURE);
+                }
+                lx->text = lx->buf;
+                if (n == 0) {
+                        lx->eof = true;
+                        return false;
+                }
+                lx->len += n;
         }
-        while (line_inx < line_len && isspace(line[line_inx])) line_inx++;
-        while (line_inx >= line_len) {
-                if (input_type == TTY) {
-                        free(line);
-                        line = readline(open_parens > 0 ? ": " : "> ");
-                        if (line == NULL) return 0;
-                        line_len = strlen(line);
-                } else {
-                        static char buf[2048];
-                        line_len = fread(buf, sizeof *buf, sizeof buf, stdin);
-                        if (line_len == 0 && feof(stdin)) {
-                                return 0;
-                        }
-                        if (ferror(stdin)) {
-                                fprintf(stderr, "Input error.\n");
-                                exit(EXIT_FAILURE);
+        lx->text = lx->buf;
+        return true;
+}
+
+/* Returns the character k places after the current one, or EOF. */
+static int peek(struct lexer *lx, size_t k)
+{
+        while (lx->inx + k >= lx->len) {
+                if (!refill(lx, lx->inx)) return EOF;
+        }
+        return (unsigned char)lx->text[lx->inx + k];
+}
+
+static inline bool is_delimiter(char c)
+{
+        return isspace((unsigned char)c) || c == '(' || c == ')';
+}
+
+enum token lexer_next(struct lexer *lx, struct datum **atom)
+{
+        for (;;) {
+                while (lx->inx < lx->len) {
+                        char c = lx->text[lx->inx];
+                        if (c == '\n') {
+                                lx->line++;
+                                lx->col = 1;
+                        } else if (isspace((unsigned char)c)) {
+                                lx->col++;
+                        } else {
+                                break;
                         }
-                        line = buf;
+                        lx->inx++;
                 }
-                line_inx = 0;
-                while (line_inx < line_len && isspace(line[line_inx])) {
-                        line_inx++;
+                if (lx->inx < lx->len) break;
+                if (!refill(lx, lx->len)) {
+                        lx->tok_line = lx->line;
+                        lx->tok_col = lx->col;
+                        return TOK_EOF;
                 }
         }
+        lx->tok_line = lx->line;
+        lx->tok_col = lx->col;
 
-        switch (line[line_inx]) {
+        switch (lx->text[lx->inx]) {
         case '(':
-                open_parens++;
-                line_inx++;
-                return '(';
+                lx->open_parens++;
+                lx->inx++;
+                lx->col++;
+                return TOK_OPEN;
         case ')':
-                if (open_parens > 0) open_parens--;
-                line_inx++;
-                return ')';
-        case '.': case '\'':
-                return line[line_inx++];
-        case '0': case '1': case '2': case '3': case '4':
-        case '5': case '6': case '7': case '8': case '9':
-        {
-                long val = 0;
-                while (line_inx < line_len && isdigit(line[line_inx])) {
-                        val = 10*val + (line[line_inx] - '0');
-                        line_inx++;
-                }
-                yylval = make_numeric_atom(val);
-                return ATOM;
+                if (lx->open_parens > 0) lx->open_parens--;
+                lx->inx++;
+                lx->col++;
+                return TOK_CLOSE;
+        case '.':
+                lx->inx++;
+                lx->col++;
+                return TOK_DOT;
+        case '\'':
+                lx->inx++;
+                lx->col++;
+                return TOK_QUOTE;
+        case '#':
+                if (peek(lx, 1) != '(') break;
+                lx->open_parens++;
+                lx->inx += 2;
+                lx->col += 2;
+                return TOK_OPEN_VECTOR;
         }
-        default:
-        {
-                int start = line_inx;
-                while (line_inx < line_len && !isspace(line[line_inx])) {
-                        char c = line[line_inx];
-                        if (c == '(' || c == ')') break;
-                        line_inx++;
+
+        size_t start = lx->inx;
+        bool number = isdigit((unsigned char)lx->text[start]);
+        for (;;) {
+                const char *t = lx->text;
+                size_t i = lx->inx;
+                if (number) {
+                        while (i < lx->len && isdigit((unsigned char)t[i])) i++;
+                } else {
+                        while (i < lx->len && !is_delimiter(t[i])) i++;
                 }
-                yylval = make_symbolic_atom(line + start, line_inx - start);
-                return ATOM;
+                lx->inx = i;
+                if (i < lx->len) break;
+                size_t scanned = i - start;
+                bool more = refill(lx, start);
+                start = lx->inx - scanned;
+                if (!more) break;
         }
+        const char *tok = lx->text + start;
+        size_t len = lx->inx - start;
+        lx->col += len;
+        if (!number) {
+                *atom = make_symbolic_atom(tok, len);
+                return TOK_ATOM;
         }
-        
+        int64_t val = 0;
+        bool overflow = false;
+        for (size_t i = 0; i < len; i++) {
+                overflow = overflow
+                        || __builtin_mul_overflow(val, 10, &val)
+                        || __builtin_add_overflow(val, tok[i] - '0', &val);
+        }
+        *atom = overflow
+                ? make_bignum_atom(bignum_from_decimal(tok, len))
+                : make_integer_atom(val);
+        return TOK_ATOM;
+}
+
+size_t lexer_line(const struct lexer *lx)
+{
+        return lx->tok_line;
+}
+
+size_t lexer_column(const struct lexer *lx)
+{
+        return lx->tok_col;
 }
 
-void yyerror(const char *msg)
+const char *lexer_name(const struct lexer *lx)
 {
-        fprintf(stderr, "%s\n", msg);
+        return lx->name;
+}
+
+void lexer_skip_line(struct lexer *lx)
+{
+        lx->open_parens = 0;
+        for (;;) {
+                while (lx->inx < lx->len) {
+                        if (lx->text[lx->inx++] == '\n') {
+                                lx->line++;
+                                lx->col = 1;
+                                return;
+                        }
+                }
+                if (!refill(lx, lx->len)) return;
+        }
 }
@@ -29,9 +29,47 @@
 #ifndef GUARD_LEXER_H
 #define GUARD_LEXER_H
 
-extern struct datum *yylval;
+#include <stdio.h>
 
-int yylex(void);
-void yyerror(const char *);
+struct datum;
+
+/* A lexer splits a source of program text into tokens.  The source is
+   either a stream, an interactive terminal read through readline, or
+   a string in memory.  Text is scanned from a contiguous buffer; a
+   token is never split across buffer refills. */
+struct lexer;
+
+enum token {
+        TOK_EOF,
+        TOK_OPEN,               /* ( */
+        TOK_OPEN_VECTOR,        /* #( */
+        TOK_CLOSE,              /* ) */
+        TOK_DOT,                /* . */
+        TOK_QUOTE,              /* ' */
+        TOK_ATOM                /* a number or a symbol */
+};
+
+/* The name is used in error messages only. */
+struct lexer *lexer_new_file(FILE *fp, const char *name);
+struct lexer *lexer_new_readline(void);
+struct lexer *lexer_new_string(const char *s, size_t len, const char *name);
+void lexer_free(struct lexer *);
+
+/* The lexer of the standard input, shared by the top level and the READ
+   primitive.  It reads through readline if the input is a terminal. */
+struct lexer *standard_input(void);
+
+/* Scans the next token.  For TOK_ATOM, the atom is stored in *atom. */
+enum token lexer_next(struct lexer *, struct datum **atom);
+
+/* The position of the first character of the token last scanned.
+   Lines and columns are counted from 1. */
+size_t lexer_line(const struct lexer *);
+size_t lexer_column(const struct lexer *);
+const char *lexer_name(const struct lexer *);
+
+/* Discards the rest of the current line (used to recover from a
+   syntax error in an interactive session). */
+void lexer_skip_line(struct lexer *);
 
 #endif /* GUARD_LEXER_H */
@@ -0,0 +1,154 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <assert.h>
+
+#include "bignum.h"
+#include "number.h"
+
+_Bool is_number(struct datum *d)
+{
+        enum data_type ty = get_type(d);
+        return ty == T_NUMBER || ty == T_INTEGER;
+}
+
+static _Bool both_integers(struct datum *a, struct datum *b)
+{
+        return get_type(a) == T_INTEGER && get_type(b) == T_INTEGER;
+}
+
+struct datum *number_add(struct datum *a, struct datum *b)
+{
+        assert(is_number(a) && is_number(b));
+        if (is_fixnum(a) && is_fixnum(b)) {
+                int64_t r;
+                if (!__builtin_add_overflow(get_fixnum_value(a),
+                                            get_fixnum_value(b), &r)) {
+                        return make_integer_atom(r);
+                }
+        }
+        if (both_integers(a, b)) {
+                return make_bignum_atom(bignum_add(get_bignum_value(a),
+                                                   get_bignum_value(b)));
+        }
+        return make_numeric_atom(get_numeric_value(a) + get_numeric_value(b));
+}
+
+struct datum *number_sub(struct datum *a, struct datum *b)
+{
+        assert(is_number(a) && is_number(b));
+        if (is_fixnum(a) && is_fixnum(b)) {
+                int64_t r;
+                if (!__builtin_sub_overflow(get_fixnum_value(a),
+                                            get_fixnum_value(b), &r)) {
+                        return make_integer_atom(r);
+                }
+        }
+        if (both_integers(a, b)) {
+                return make_bignum_atom(bignum_sub(get_bignum_value(a),
+                                                   get_bignum_value(b)));
+        }
+        return make_numeric_atom(get_numeric_value(a) - get_numeric_value(b));
+}
+
+struct datum *number_mul(struct datum *a, struct datum *b)
+{
+        assert(is_number(a) && is_number(b));
+        if (is_fixnum(a) && is_fixnum(b)) {
+                int64_t r;
+                if (!__builtin_mul_overflow(get_fixnum_value(a),
+                                            get_fixnum_value(b), &r)) {
+                        return make_integer_atom(r);
+                }
+        }
+        if (both_integers(a, b)) {
+                return make_bignum_atom(bignum_mul(get_bignum_value(a),
+                                                   get_bignum_value(b)));
+        }
+        return make_numeric_atom(get_numeric_value(a) * get_numeric_value(b));
+}
+
+struct datum *number_div(struct datum *a, struct datum *b)
+{
+        assert(is_number(a) && is_number(b));
+        if (is_fixnum(a) && is_fixnum(b)) {
+                // fixnums are narrower than int64_t, so INT64_MIN / -1
+                // cannot occur here
+                int64_t x = get_fixnum_value(a);
+                int64_t y = get_fixnum_value(b);
+                if (y != 0 && x % y == 0) return make_integer_atom(x / y);
+        } else if (both_integers(a, b)) {
+                struct bignum *y = get_bignum_value(b);
+                if (!bignum_is_zero(y)) {
+                        struct bignum *q, *r;
+                        bignum_divmod(get_bignum_value(a), y, &q, &r);
+                        if (bignum_is_zero(r)) return make_bignum_atom(q);
+                }
+        }
+        return make_numeric_atom(get_numeric_value(a) / get_numeric_value(b));
+}
+
+_Bool number_equal(struct datum *a, struct datum *b)
+{
+        assert(is_number(a) && is_number(b));
+        if (is_fixnum(a) && is_fixnum(b)) {
+                return get_fixnum_value(a) == get_fixnum_value(b);
+        }
+        if (both_integers(a, b)) {
+                return bignum_cmp(get_bignum_value(a),
+                                  get_bignum_value(b)) == 0;
+        }
+        return get_numeric_value(a) == get_numeric_value(b);
+}
+
+int number_compare(struct datum *a, struct datum *b)
+{
+        assert(is_number(a) && is_number(b));
+        if (is_fixnum(a) && is_fixnum(b)) {
+                int64_t x = get_fixnum_value(a);
+                int64_t y = get_fixnum_value(b);
+                return (x > y) - (x < y);
+        }
+        if (both_integers(a, b)) {
+                // a bignum is always outside the fixnum range, so its
+                // sign decides; get_bignum_value would allocate for a
+                // fixnum
+                if (is_fixnum(a)) {
+                        return bignum_to_double(get_bignum_value(b)) > 0
+                                ? -1 : 1;
+                }
+                if (is_fixnum(b)) {
+                        return bignum_to_double(get_bignum_value(a)) > 0
+                                ? 1 : -1;
+                }
+                return bignum_cmp(get_bignum_value(a), get_bignum_value(b));
+        }
+        double x = get_numeric_value(a);
+        double y = get_numeric_value(b);
+        return (x > y) - (x < y);
+}
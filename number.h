@@ -0,0 +1,62 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+ 
+#ifndef GUARD_NUMBER_H
+#define GUARD_NUMBER_H
+
+#include "data.h"
+
+/* Arithmetic on numeric data.  Exact integers stay exact: fixnum
+   operations are checked for overflow and promoted to bignums when
+   needed, and results that fit are demoted back to fixnums.  If
+   either operand is a floating-point number, the operation is done in
+   floating point.
+
+   All functions here require that both arguments satisfy is_number.
+ */
+
+// true for T_NUMBER and T_INTEGER
+_Bool is_number(struct datum *);
+
+struct datum *number_add(struct datum *, struct datum *);
+struct datum *number_sub(struct datum *, struct datum *);
+struct datum *number_mul(struct datum *, struct datum *);
+
+// The quotient of two integers is exact if the division leaves no
+// remainder, and a floating-point number otherwise.
+struct datum *number_div(struct datum *, struct datum *);
+
+_Bool number_equal(struct datum *, struct datum *);
+
+// Returns a negative number, zero or a positive number as the first
+// argument is less than, equal to or greater than the second.  Does
+// not allocate, so it may be called from threads other than the main
+// one.
+int number_compare(struct datum *, struct datum *);
+
+#endif /* GUARD_NUMBER_H */
@@ -26,16 +26,70 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
+#include "alloc.h"
 #include "error.h"
+#include "eval.h"
+#include "f64vec.h"
+#include "hash.h"
+#include "heap_profile.h"
+#include "lexer.h"
+#include "number.h"
 #include "primops.h"
 #include "printer.h"
+#include "pvec.h"
+#include "reader.h"
+#include "sort.h"
+
+/* Builds a list front to back in one pass. */
+struct list_builder {
+        struct datum *head, *tail;
+};
+#define LIST_BUILDER_INIT { NULL, NULL }
+
+static void list_add(struct list_builder *b, struct datum *x)
+{
+        struct datum *p = make_pair(x, make_NIL());
+        if (b->head == NULL) {
+                b->head = p;
+        } else {
+                set_pair_second(b->tail, p);
+        }
+        b->tail = p;
+}
+
+static struct datum *list_finish(struct list_builder *b,
+                                 struct datum *terminator)
+{
+        if (b->head == NULL) return terminator;
+        if (!is_NIL(terminator)) set_pair_second(b->tail, terminator);
+        return b->head;
+}
+
+/* Where a primitive takes a name, accept both a symbol and a quoted
+   symbol, since (QUOTE x) evaluates to itself. */
+static struct datum *strip_quote(struct datum *d)
+{
+        if (get_type(d) == T_PAIR
+            && is_this_symbol(get_pair_first(d), "QUOTE")
+            && get_type(get_pair_second(d)) == T_PAIR) {
+                return get_pair_first(get_pair_second(d));
+        }
+        return d;
+}
 
 static struct datum *prim_EQ(struct datum *d)
 {
         if (is_NIL(d)) return make_T();
         if (get_type(d) != T_PAIR) {
-                return make_error(d, "EQ: Improper parameter.");
+                raise_error(d, "EQ: Improper parameter.");
         }
         struct datum *prev = get_pair_first(d);
         struct datum *it;
@@ -43,41 +97,54 @@ static struct datum *prim_EQ(struct datum *d)
              get_type(it) == T_PAIR;
              it = get_pair_second(it)) {
                 struct datum *cur = get_pair_first(it);
+                if (is_number(prev) && is_number(cur)) {
+                        if (!number_equal(prev, cur)) return make_NIL();
+                        continue;
+                }
                 if (get_type(prev) != get_type(cur)) return make_NIL();
                 switch (get_type(cur)) {
-                case T_NUMBER:
-                        if (get_numeric_value(prev) !=
-                            get_numeric_value(cur)) return make_NIL();
-                        break;
+                case T_NUMBER: case T_INTEGER:
+                        NOTREACHED;
                 case T_SYMBOL:
                         if (!is_this_symbol(cur, get_symbol_name(prev))) {
                                 return make_NIL();
                         }
                         break;
-                case T_PAIR: case T_PRIMITIVE: case T_CLOSURE:
+                case T_HASH: case T_VECTOR: case T_F64VEC: case T_PROMISE:
+                        if (cur != prev) return make_NIL();
+                        break;
+                case T_PAIR: case T_PRIMITIVE: case T_CLOSURE: case T_ERROR:
                         return make_NIL();
-                case T_ERROR:
-                        NOTREACHED;
                 }
         }
         if (!is_NIL(it)) {
-                return make_error(d, "EQ: Improper parameter.");
+                raise_error(d, "EQ: Improper parameter.");
         }
         return make_T();
 }
 
+static struct datum *prim_EQUAL(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 2 || !is_NIL(dd.terminator)) {
+                raise_error(d, "EQUAL: incorrect parameter list");
+        }
+        return data_equal(dd.vec[0], dd.vec[1]) ? make_T() : make_NIL();
+}
+
 static struct datum *prim_ATOM(struct datum *d)
 {
         if (get_type(d) != T_PAIR) return make_NIL();
         enum data_type ty = get_type(get_pair_first(d));
-        return ty == T_SYMBOL || ty == T_NUMBER ? make_T() : make_NIL();
+        return ty == T_SYMBOL || ty == T_NUMBER || ty == T_INTEGER
+                ? make_T() : make_NIL();
 }
 
 static struct datum *prim_CONS(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 2 || !is_NIL(dd.terminator)) {
-                return make_error(d, "CONS: incorrect parameter list");
+                raise_error(d, "CONS: incorrect parameter list");
         }
         return make_pair(dd.vec[0], dd.vec[1]);
 }
@@ -86,10 +153,10 @@ static struct datum *prim_CAR(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 1 || !is_NIL(dd.terminator)) {
-                return make_error(d, "CAR: incorrect parameter list");
+                raise_error(d, "CAR: incorrect parameter list");
         }
         if (get_type(dd.vec[0]) != T_PAIR) {
-                return make_error(d, "CAR: not a pair");
+                raise_error(d, "CAR: not a pair");
         }
         return get_pair_first(dd.vec[0]);
 }
@@ -98,87 +165,907 @@ static struct datum *prim_CDR(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 1 || !is_NIL(dd.terminator)) {
-                return make_error(d, "CDR: incorrect parameter list");
+                raise_error(d, "CDR: incorrect parameter list");
         }
         if (get_type(dd.vec[0]) != T_PAIR) {
-                return make_error(d, "CDR: not a pair");
+                raise_error(d, "CDR: not a pair");
         }
         return get_pair_second(dd.vec[0]);
 }
 
+/* Checks that the parameter list d has n elements, and that the one at
+   index list is a proper list. */
+static struct list_data list_args(struct datum *d, size_t n, size_t list,
+                                  const char *name)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != n || !is_NIL(dd.terminator)) {
+                raise_error(d, "%s: incorrect parameter list", name);
+        }
+        struct datum *it = dd.vec[list];
+        while (get_type(it) == T_PAIR) it = get_pair_second(it);
+        if (!is_NIL(it)) raise_error(d, "%s: improper list", name);
+        return dd;
+}
+
+static struct datum *prim_LENGTH(struct datum *d)
+{
+        struct list_data dd = list_args(d, 1, 0, "LENGTH");
+        int64_t n = 0;
+        for (struct datum *it = dd.vec[0]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                n++;
+        }
+        return make_integer_atom(n);
+}
+
+static struct datum *prim_APPEND(struct datum *d)
+{
+        // all but the last list are copied; the last is shared
+        struct list_data dd = get_list_data(d);
+        if (!is_NIL(dd.terminator)) {
+                raise_error(d, "APPEND: incorrect parameter list");
+        }
+        if (dd.n == 0) return make_NIL();
+        struct list_builder b = LIST_BUILDER_INIT;
+        for (size_t i = 0; i + 1 < dd.n; i++) {
+                struct datum *it;
+                for (it = dd.vec[i]; get_type(it) == T_PAIR;
+                     it = get_pair_second(it)) {
+                        list_add(&b, get_pair_first(it));
+                }
+                if (!is_NIL(it)) raise_error(d, "APPEND: improper list");
+        }
+        alloc_keep_alive(dd.vec);
+        return list_finish(&b, dd.vec[dd.n - 1]);
+}
+
+static struct datum *prim_REVERSE(struct datum *d)
+{
+        struct list_data dd = list_args(d, 1, 0, "REVERSE");
+        struct datum *rv = make_NIL();
+        for (struct datum *it = dd.vec[0]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                rv = make_pair(get_pair_first(it), rv);
+        }
+        return rv;
+}
+
+static struct datum *prim_NTH(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 2 || !is_NIL(dd.terminator)) {
+                raise_error(d, "NTH: incorrect parameter list");
+        }
+        if (!is_fixnum(dd.vec[0]) || get_fixnum_value(dd.vec[0]) < 0) {
+                raise_error(d, "NTH: index is not a nonnegative integer");
+        }
+        struct datum *it = dd.vec[1];
+        for (int64_t i = get_fixnum_value(dd.vec[0]);
+             i > 0 && get_type(it) == T_PAIR; i--) {
+                it = get_pair_second(it);
+        }
+        return get_type(it) == T_PAIR ? get_pair_first(it) : make_NIL();
+}
+
+static struct datum *prim_LAST(struct datum *d)
+{
+        struct list_data dd = list_args(d, 1, 0, "LAST");
+        struct datum *it = dd.vec[0];
+        if (is_NIL(it)) return it;
+        while (!is_NIL(get_pair_second(it))) it = get_pair_second(it);
+        return get_pair_first(it);
+}
+
+static struct datum *prim_MEMBER(struct datum *d)
+{
+        struct list_data dd = list_args(d, 2, 1, "MEMBER");
+        for (struct datum *it = dd.vec[1]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                if (data_equal(dd.vec[0], get_pair_first(it))) return it;
+        }
+        return make_NIL();
+}
+
+static struct datum *prim_ASSOC(struct datum *d)
+{
+        struct list_data dd = list_args(d, 2, 1, "ASSOC");
+        for (struct datum *it = dd.vec[1]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                struct datum *entry = get_pair_first(it);
+                if (get_type(entry) != T_PAIR) {
+                        raise_error(d, "ASSOC: element is not a pair");
+                }
+                if (data_equal(dd.vec[0], get_pair_first(entry))) {
+                        return entry;
+                }
+        }
+        return make_NIL();
+}
+
+static struct datum *call1(struct datum *f, struct datum *x)
+{
+        return eval_apply(f, make_pair(x, make_NIL()));
+}
+
+static struct datum *prim_MAP(struct datum *d)
+{
+        struct list_data dd = list_args(d, 2, 1, "MAP");
+        struct list_builder b = LIST_BUILDER_INIT;
+        for (struct datum *it = dd.vec[1]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                list_add(&b, call1(dd.vec[0], get_pair_first(it)));
+        }
+        return list_finish(&b, make_NIL());
+}
+
+static struct datum *prim_FILTER(struct datum *d)
+{
+        struct list_data dd = list_args(d, 2, 1, "FILTER");
+        struct list_builder b = LIST_BUILDER_INIT;
+        for (struct datum *it = dd.vec[1]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                struct datum *x = get_pair_first(it);
+                if (!is_NIL(call1(dd.vec[0], x))) list_add(&b, x);
+        }
+        return list_finish(&b, make_NIL());
+}
+
+static struct datum *prim_FOLD(struct datum *d)
+{
+        struct list_data dd = list_args(d, 3, 2, "FOLD");
+        struct datum *acc = dd.vec[1];
+        for (struct datum *it = dd.vec[2]; !is_NIL(it);
+             it = get_pair_second(it)) {
+                acc = eval_apply(dd.vec[0],
+                                 make_pair(acc, make_pair(get_pair_first(it),
+                                                          make_NIL())));
+        }
+        return acc;
+}
+
+/* Promises and streams.  A stream is NIL or a pair of its first
+   element and a promise of the rest of the stream.  The promises made
+   by STREAM-MAP and STREAM-FILTER apply primitives private to this
+   file, so that the work on an element is done only once something
+   asks for the rest of the stream before it. */
+
+static struct datum *force(struct datum *p)
+{
+        if (get_type(p) != T_PROMISE) return p;
+        struct datum *v = get_promise_value(p);
+        if (v != NULL) return v;
+        v = eval_apply(get_promise_fun(p), get_promise_arg(p));
+        // if forcing p again while computing v has already given it a
+        // value, that value stays
+        if (get_promise_value(p) != NULL) return get_promise_value(p);
+        set_promise_value(p, v);
+        return v;
+}
+
+static struct datum *prim_FORCE(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 1 || !is_NIL(dd.terminator)) {
+                raise_error(d, "FORCE: incorrect parameter list");
+        }
+        return force(dd.vec[0]);
+}
+
+static struct datum *check_stream(struct datum *d, struct datum *s,
+                                  const char *name)
+{
+        if (!is_NIL(s) && (get_type(s) != T_PAIR ||
+                           get_type(get_pair_second(s)) != T_PROMISE)) {
+                raise_error(d, "%s: not a stream", name);
+        }
+        return s;
+}
+
+// the rest of the nonempty stream s
+static struct datum *stream_rest(struct datum *d, struct datum *s,
+                                 const char *name)
+{
+        return check_stream(d, force(get_pair_second(s)), name);
+}
+
+// the stream arguments of a primitive taking n arguments, the last
+// one a stream
+static struct list_data stream_args(struct datum *d, size_t n,
+                                    const char *name)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != n || !is_NIL(dd.terminator)) {
+                raise_error(d, "%s: incorrect parameter list", name);
+        }
+        check_stream(d, dd.vec[n - 1], name);
+        return dd;
+}
+
+static struct datum *prim_STREAM_CONS(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 2 || !is_NIL(dd.terminator)) {
+                raise_error(d, "STREAM-CONS: incorrect parameter list");
+        }
+        if (get_type(dd.vec[1]) != T_PROMISE) {
+                raise_error(d, "STREAM-CONS: the rest is not a promise");
+        }
+        return make_pair(dd.vec[0], dd.vec[1]);
+}
+
+static struct datum *prim_STREAM_CAR(struct datum *d)
+{
+        struct list_data dd = stream_args(d, 1, "STREAM-CAR");
+        if (is_NIL(dd.vec[0])) raise_error(d, "STREAM-CAR: empty stream");
+        return get_pair_first(dd.vec[0]);
+}
+
+static struct datum *prim_STREAM_CDR(struct datum *d)
+{
+        struct list_data dd = stream_args(d, 1, "STREAM-CDR");
+        if (is_NIL(dd.vec[0])) raise_error(d, "STREAM-CDR: empty stream");
+        return stream_rest(d, dd.vec[0], "STREAM-CDR");
+}
+
+// a promise to apply the private primitive *prim, made by fun when
+// first needed, to the arguments a and b
+static struct datum *promise2(struct datum **prim, prim_fun fun,
+                              struct datum *a, struct datum *b)
+{
+        if (*prim == NULL) *prim = make_primitive(fun);
+        return make_promise(*prim, make_pair(a, make_pair(b, make_NIL())));
+}
+
+static struct datum *stream_map(struct datum *f, struct datum *s);
+
+// (f s): the map of the rest of the nonempty stream s
+static struct datum *stream_map_next(struct datum *d)
+{
+        struct datum *s = get_pair_first(get_pair_second(d));
+        return stream_map(get_pair_first(d),
+                          stream_rest(d, s, "STREAM-MAP"));
+}
+
+static struct datum *stream_map(struct datum *f, struct datum *s)
+{
+        static struct datum *next = NULL;
+        if (is_NIL(s)) return s;
+        return make_pair(call1(f, get_pair_first(s)),
+                         promise2(&next, stream_map_next, f, s));
+}
+
+static struct datum *prim_STREAM_MAP(struct datum *d)
+{
+        struct list_data dd = stream_args(d, 2, "STREAM-MAP");
+        return stream_map(dd.vec[0], dd.vec[1]);
+}
+
+static struct datum *stream_filter(struct datum *d, struct datum *p,
+                                   struct datum *s);
+
+// (p s): the filtering of the rest of the nonempty stream s
+static struct datum *stream_filter_next(struct datum *d)
+{
+        struct datum *p = get_pair_first(d);
+        struct datum *s = get_pair_first(get_pair_second(d));
+        return stream_filter(d, p, stream_rest(d, s, "STREAM-FILTER"));
+}
+
+static struct datum *stream_filter(struct datum *d, struct datum *p,
+                                   struct datum *s)
+{
+        static struct datum *next = NULL;
+        while (!is_NIL(s) && is_NIL(call1(p, get_pair_first(s)))) {
+                s = stream_rest(d, s, "STREAM-FILTER");
+        }
+        if (is_NIL(s)) return s;
+        return make_pair(get_pair_first(s),
+                         promise2(&next, stream_filter_next, p, s));
+}
+
+static struct datum *prim_STREAM_FILTER(struct datum *d)
+{
+        struct list_data dd = stream_args(d, 2, "STREAM-FILTER");
+        return stream_filter(d, dd.vec[0], dd.vec[1]);
+}
+
+static struct datum *prim_STREAM_TAKE(struct datum *d)
+{
+        struct list_data dd = stream_args(d, 2, "STREAM-TAKE");
+        if (!is_fixnum(dd.vec[0]) || get_fixnum_value(dd.vec[0]) < 0) {
+                raise_error(d, "STREAM-TAKE: count is not a nonnegative"
+                            " integer");
+        }
+        struct list_builder b = LIST_BUILDER_INIT;
+        struct datum *s = dd.vec[1];
+        // the rest after the last element taken is not forced
+        for (int64_t i = get_fixnum_value(dd.vec[0]); i > 0 && !is_NIL(s);
+             i--) {
+                list_add(&b, get_pair_first(s));
+                if (i > 1) s = stream_rest(d, s, "STREAM-TAKE");
+        }
+        return list_finish(&b, make_NIL());
+}
+
+static _Bool number_less(struct datum *a, struct datum *b, void *arg)
+{
+        (void)arg;
+        return number_compare(a, b) < 0;
+}
+
+static _Bool symbol_less(struct datum *a, struct datum *b, void *arg)
+{
+        (void)arg;
+        return strcasecmp(get_symbol_name(a), get_symbol_name(b)) < 0;
+}
+
+static _Bool closure_less(struct datum *a, struct datum *b, void *arg)
+{
+        return !is_NIL(eval_apply(arg, make_pair(a, make_pair(b,
+                                                             make_NIL()))));
+}
+
+static struct datum *prim_SORT(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n < 1 || dd.n > 2 || !is_NIL(dd.terminator)) {
+                raise_error(d, "SORT: incorrect parameter list");
+        }
+        struct list_data l = get_list_data(dd.vec[0]);
+        if (!is_NIL(l.terminator)) raise_error(d, "SORT: improper list");
+
+        // the built-in orderings compare without calling back into the
+        // evaluator, so they can be sorted in parallel
+        struct datum *order = dd.n == 2 ? strip_quote(dd.vec[1]) : NULL;
+        if (order == NULL || is_this_symbol(order, "NUMBER")) {
+                for (size_t i = 0; i < l.n; i++) {
+                        if (!is_number(l.vec[i])) {
+                                raise_error(d, "SORT: not a number");
+                        }
+                }
+                sort_data(l.vec, l.n, number_less, NULL, 1);
+        } else if (is_this_symbol(order, "SYMBOL")) {
+                for (size_t i = 0; i < l.n; i++) {
+                        if (get_type(l.vec[i]) != T_SYMBOL) {
+                                raise_error(d, "SORT: not a symbol");
+                        }
+                }
+                sort_data(l.vec, l.n, symbol_less, NULL, 1);
+        } else if (get_type(order) == T_PRIMITIVE
+                   || get_type(order) == T_CLOSURE) {
+                sort_data(l.vec, l.n, closure_less, order, 0);
+        } else {
+                raise_error(d, "SORT: unknown ordering");
+        }
+
+        struct datum *rv = make_NIL();
+        for (size_t i = l.n; i-- > 0; ) rv = make_pair(l.vec[i], rv);
+        alloc_keep_alive(l.vec);
+        return rv;
+}
+
 static struct datum *prim_ADD(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 2 || !is_NIL(dd.terminator)) {
-                return make_error(d, "ADD: incorrect parameter list");
+                raise_error(d, "ADD: incorrect parameter list");
         }
-        if (get_type(dd.vec[0]) != T_NUMBER ||
-            get_type(dd.vec[1]) != T_NUMBER) {
-                return make_error(d, "ADD: type error");
+        if (!is_number(dd.vec[0]) || !is_number(dd.vec[1])) {
+                raise_error(d, "ADD: type error");
         }
-        return make_numeric_atom(get_numeric_value(dd.vec[0])
-                                 +
-                                 get_numeric_value(dd.vec[1]));
+        return number_add(dd.vec[0], dd.vec[1]);
 }
         
 static struct datum *prim_SUB(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 2 || !is_NIL(dd.terminator)) {
-                return make_error(d, "SUB: incorrect parameter list");
+                raise_error(d, "SUB: incorrect parameter list");
         }
-        if (get_type(dd.vec[0]) != T_NUMBER ||
-            get_type(dd.vec[1]) != T_NUMBER) {
-                return make_error(d, "SUB: type error");
+        if (!is_number(dd.vec[0]) || !is_number(dd.vec[1])) {
+                raise_error(d, "SUB: type error");
         }
-        return make_numeric_atom(get_numeric_value(dd.vec[0])
-                                 -
-                                 get_numeric_value(dd.vec[1]));
+        return number_sub(dd.vec[0], dd.vec[1]);
 }
         
 static struct datum *prim_MUL(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 2 || !is_NIL(dd.terminator)) {
-                return make_error(d, "MUL: incorrect parameter list");
+                raise_error(d, "MUL: incorrect parameter list");
         }
-        if (get_type(dd.vec[0]) != T_NUMBER ||
-            get_type(dd.vec[1]) != T_NUMBER) {
-                return make_error(d, "MUL: type error");
+        if (!is_number(dd.vec[0]) || !is_number(dd.vec[1])) {
+                raise_error(d, "MUL: type error");
         }
-        return make_numeric_atom(get_numeric_value(dd.vec[0])
-                                 *
-                                 get_numeric_value(dd.vec[1]));
+        return number_mul(dd.vec[0], dd.vec[1]);
 }
 
 static struct datum *prim_DIV(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 2 || !is_NIL(dd.terminator)) {
-                return make_error(d, "DIV: incorrect parameter list");
+                raise_error(d, "DIV: incorrect parameter list");
         }
-        if (get_type(dd.vec[0]) != T_NUMBER ||
-            get_type(dd.vec[1]) != T_NUMBER) {
-                return make_error(d, "DIV: type error");
+        if (!is_number(dd.vec[0]) || !is_number(dd.vec[1])) {
+                raise_error(d, "DIV: type error");
         }
-        return make_numeric_atom(get_numeric_value(dd.vec[0])
-                                 /
-                                 get_numeric_value(dd.vec[1]));
+        return number_div(dd.vec[0], dd.vec[1]);
 }
 
 static struct datum *prim_PRINT(struct datum *d)
 {
         struct list_data dd = get_list_data(d);
         if (dd.n != 1 || !is_NIL(dd.terminator)) {
-                return make_error(d, "PRINT: incorrect parameter list");
+                raise_error(d, "PRINT: incorrect parameter list");
         }
         print_sexp(dd.vec[0], stdout);
         putchar('\n');
         return make_NIL();
 }
 
+static struct datum *prim_HEAP_PROFILE(struct datum *d)
+{
+        if (!is_NIL(d)) {
+                raise_error(d, "HEAP-PROFILE: incorrect parameter list");
+        }
+        if (!heap_profile_on) {
+                raise_error(d, "HEAP-PROFILE: not profiling"
+                            " (run with --heap-profile)");
+        }
+        heap_profile_print(stdout);
+        return make_NIL();
+}
+
+static struct datum *read_or_raise(struct lexer *lx)
+{
+        struct datum *rv;
+        switch (read_datum(lx, &rv)) {
+        case READ_OK:
+                return rv;
+        case READ_EOF:
+                return make_EOF();
+        case READ_ERROR:
+                raise_error_value(rv);
+        }
+        NOTREACHED;
+}
+
+static struct datum *prim_READ(struct datum *d)
+{
+        if (!is_NIL(d)) raise_error(d, "READ: incorrect parameter list");
+        fflush(stdout);
+        return read_or_raise(standard_input());
+}
 
+/* Files being read by READ-FROM, each open until its end is reached. */
+struct input_file {
+        char *name;
+        FILE *fp;
+        struct lexer *lx;
+        struct input_file *next;
+};
+static struct input_file *input_files = NULL;
 
+static struct datum *prim_READ_FROM(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 1 || !is_NIL(dd.terminator)) {
+                raise_error(d, "READ-FROM: incorrect parameter list");
+        }
+        struct datum *file = strip_quote(dd.vec[0]);
+        if (get_type(file) != T_SYMBOL) {
+                raise_error(d, "READ-FROM: file name is not a symbol");
+        }
+        const char *name = get_symbol_name(file);
+
+        struct input_file **ip = &input_files;
+        while (*ip != NULL && strcmp((*ip)->name, name) != 0) {
+                ip = &(*ip)->next;
+        }
+        struct input_file *in = *ip;
+        if (in == NULL) {
+                FILE *fp = fopen(name, "r");
+                if (fp == NULL) {
+                        const char *msg = strerror(errno);
+                        char *copy = alloc_atomic(strlen(msg) + 1);
+                        raise_error(d, "READ-FROM: %s: %s", name,
+                                    strcpy(copy, msg));
+                }
+                in = malloc(sizeof *in);
+                char *copy = malloc(strlen(name) + 1);
+                if (in == NULL || copy == NULL) enomem();
+                in->name = strcpy(copy, name);
+                in->fp = fp;
+                in->lx = lexer_new_file(fp, in->name);
+                in->next = input_files;
+                input_files = in;
+                ip = &input_files;
+        }
+
+        struct datum *rv = read_or_raise(in->lx);
+        if (is_EOF(rv)) {
+                *ip = in->next;
+                lexer_free(in->lx);
+                fclose(in->fp);
+                free(in->name);
+                free(in);
+        }
+        return rv;
+}
+
+static struct datum *prim_EOF_P(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 1 || !is_NIL(dd.terminator)) {
+                raise_error(d, "EOF-P: incorrect parameter list");
+        }
+        return is_EOF(dd.vec[0]) ? make_T() : make_NIL();
+}
+
+/* Checks that the parameter list d has n elements (or n or n + 1 if
+   optional is set) and that the first is a hash table. */
+static struct list_data hash_args(struct datum *d, size_t n, _Bool optional,
+                                  const char *name)
+{
+        struct list_data dd = get_list_data(d);
+        if ((dd.n != n && !(optional && dd.n == n + 1))
+            || !is_NIL(dd.terminator)) {
+                raise_error(d, "%s: incorrect parameter list", name);
+        }
+        if (n > 0 && get_type(dd.vec[0]) != T_HASH) {
+                raise_error(d, "%s: not a hash table", name);
+        }
+        return dd;
+}
+
+static struct datum *prim_MAKE_HASH(struct datum *d)
+{
+        hash_args(d, 0, 0, "MAKE-HASH");
+        return make_hash_table();
+}
+
+static struct datum *prim_HASH_GET(struct datum *d)
+{
+        struct list_data dd = hash_args(d, 2, 1, "HASH-GET");
+        struct datum *rv = hash_get(get_hash_table(dd.vec[0]), dd.vec[1]);
+        if (rv != NULL) return rv;
+        return dd.n == 3 ? dd.vec[2] : make_NIL();
+}
+
+static struct datum *prim_HASH_PUT(struct datum *d)
+{
+        struct list_data dd = hash_args(d, 3, 0, "HASH-PUT");
+        hash_put(get_hash_table(dd.vec[0]), dd.vec[1], dd.vec[2]);
+        return dd.vec[2];
+}
+
+static struct datum *prim_HASH_DEL(struct datum *d)
+{
+        struct list_data dd = hash_args(d, 2, 0, "HASH-DEL");
+        return hash_del(get_hash_table(dd.vec[0]), dd.vec[1])
+                ? make_T() : make_NIL();
+}
+
+static struct datum *prim_HASH_COUNT(struct datum *d)
+{
+        struct list_data dd = hash_args(d, 1, 0, "HASH-COUNT");
+        return make_integer_atom(hash_count(get_hash_table(dd.vec[0])));
+}
+
+struct binding_list {
+        struct list_builder b;
+        _Bool pairs;
+};
+
+static void collect_binding(struct datum *key, struct datum *value, void *arg)
+{
+        struct binding_list *bl = arg;
+        list_add(&bl->b, bl->pairs ? make_pair(key, value) : key);
+}
+
+static struct datum *hash_list(struct datum *d, _Bool pairs, const char *name)
+{
+        struct list_data dd = hash_args(d, 1, 0, name);
+        struct binding_list bl = { LIST_BUILDER_INIT, pairs };
+        hash_for_each(get_hash_table(dd.vec[0]), collect_binding, &bl);
+        return list_finish(&bl.b, make_NIL());
+}
+
+static struct datum *prim_HASH_KEYS(struct datum *d)
+{
+        return hash_list(d, 0, "HASH-KEYS");
+}
+
+static struct datum *prim_HASH_ALIST(struct datum *d)
+{
+        return hash_list(d, 1, "HASH-ALIST");
+}
+
+/* Checks that the parameter list d has n elements, the first of which
+   is a vector. */
+static struct list_data vector_args(struct datum *d, size_t n,
+                                    const char *name)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != n || !is_NIL(dd.terminator)) {
+                raise_error(d, "%s: incorrect parameter list", name);
+        }
+        if (get_type(dd.vec[0]) != T_VECTOR) {
+                raise_error(d, "%s: not a vector", name);
+        }
+        return dd;
+}
+
+static size_t vector_index(struct datum *d, struct datum *v, struct datum *i,
+                           const char *name)
+{
+        if (!is_fixnum(i) || get_fixnum_value(i) < 0
+            || (uint64_t)get_fixnum_value(i) >= pvec_length(get_vector(v))) {
+                raise_error(d, "%s: index out of range", name);
+        }
+        return get_fixnum_value(i);
+}
+
+static struct datum *prim_VECTOR(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (!is_NIL(dd.terminator)) {
+                raise_error(d, "VECTOR: incorrect parameter list");
+        }
+        return make_vector(pvec_from_array(dd.vec, dd.n));
+}
+
+static struct datum *prim_LIST_TO_VECTOR(struct datum *d)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != 1 || !is_NIL(dd.terminator)) {
+                raise_error(d, "LIST-TO-VECTOR: incorrect parameter list");
+        }
+        struct list_data ld = get_list_data(dd.vec[0]);
+        if (!is_NIL(ld.terminator)) {
+                raise_error(d, "LIST-TO-VECTOR: improper list");
+        }
+        return make_vector(pvec_from_array(ld.vec, ld.n));
+}
+
+static struct datum *prim_VECTOR_TO_LIST(struct datum *d)
+{
+        struct list_data dd = vector_args(d, 1, "VECTOR-TO-LIST");
+        return vector_to_list(dd.vec[0]);
+}
+
+static struct datum *prim_VLENGTH(struct datum *d)
+{
+        struct list_data dd = vector_args(d, 1, "VLENGTH");
+        return make_integer_atom(pvec_length(get_vector(dd.vec[0])));
+}
+
+static struct datum *prim_VREF(struct datum *d)
+{
+        struct list_data dd = vector_args(d, 2, "VREF");
+        size_t i = vector_index(d, dd.vec[0], dd.vec[1], "VREF");
+        return pvec_ref(get_vector(dd.vec[0]), i);
+}
+
+static struct datum *prim_VSET(struct datum *d)
+{
+        struct list_data dd = vector_args(d, 3, "VSET");
+        size_t i = vector_index(d, dd.vec[0], dd.vec[1], "VSET");
+        return make_vector(pvec_set(get_vector(dd.vec[0]), i, dd.vec[2]));
+}
+
+static struct datum *prim_VPUSH(struct datum *d)
+{
+        struct list_data dd = vector_args(d, 2, "VPUSH");
+        return make_vector(pvec_push(get_vector(dd.vec[0]), dd.vec[1]));
+}
+
+/* Checks that the parameter list d has n elements, of which the first
+   nvec are F64VECs of the same length. */
+static struct list_data f64vec_args(struct datum *d, size_t n, size_t nvec,
+                                    const char *name)
+{
+        struct list_data dd = get_list_data(d);
+        if (dd.n != n || !is_NIL(dd.terminator)) {
+                raise_error(d, "%s: incorrect parameter list", name);
+        }
+        for (size_t i = 0; i < nvec; i++) {
+                if (get_type(dd.vec[i]) != T_F64VEC) {
+                        raise_error(d, "%s: not an F64VEC", name);
+                }
+                if (get_f64vec_length(dd.vec[i])
+                    != get_f64vec_length(dd.vec[0])) {
+                        raise_error(d, "%s: lengths differ", name);
+                }
+        }
+        return dd;
+}
+
+static struct datum *list_to_f64vec(struct datum *d, struct datum *l,
+                                    const char *name)
+{
+        size_t n = 0;
+        struct datum *it;
+        for (it = l; get_type(it) == T_PAIR; it = get_pair_second(it)) {
+                if (!is_number(get_pair_first(it))) {
+                        raise_error(d, "%s: type error", name);
+                }
+                n++;
+        }
+        if (!is_NIL(it)) raise_error(d, "%s: improper list", name);
+        struct datum *rv = make_f64vec(n);
+        double *v = get_f64vec_data(rv);
+        for (it = l; n-- > 0; it = get_pair_second(it)) {
+                *v++ = get_numeric_value(get_pair_first(it));
+        }
+        return rv;
+}
+
+static struct datum *prim_F64VEC(struct datum *d)
+{
+        return list_to_f64vec(d, d, "F64VEC");
+}
+
+static struct datum *prim_LIST_TO_F64VEC(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 1, 0, "LIST-TO-F64VEC");
+        return list_to_f64vec(d, dd.vec[0], "LIST-TO-F64VEC");
+}
+
+static struct datum *prim_F64VEC_TO_LIST(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 1, 1, "F64VEC-TO-LIST");
+        const double *v = get_f64vec_data(dd.vec[0]);
+        struct datum *rv = make_NIL();
+        for (size_t i = get_f64vec_length(dd.vec[0]); i-- > 0; ) {
+                rv = make_pair(make_numeric_atom(v[i]), rv);
+        }
+        return rv;
+}
+
+static struct datum *prim_F64VEC_LENGTH(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 1, 1, "F64VEC-LENGTH");
+        return make_integer_atom(get_f64vec_length(dd.vec[0]));
+}
+
+static struct datum *prim_F64VEC_REF(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 2, 1, "F64VEC-REF");
+        if (!is_fixnum(dd.vec[1])
+            || get_fixnum_value(dd.vec[1]) < 0
+            || (uint64_t)get_fixnum_value(dd.vec[1])
+               >= get_f64vec_length(dd.vec[0])) {
+                raise_error(d, "F64VEC-REF: index out of range");
+        }
+        return make_numeric_atom(get_f64vec_data(dd.vec[0])
+                                 [get_fixnum_value(dd.vec[1])]);
+}
+
+#define F64VEC_BINOP(NAME, name, kernel)                                \
+        static struct datum *prim_F64VEC_##NAME(struct datum *d)        \
+        {                                                               \
+                struct list_data dd = f64vec_args(d, 2, 2, name);       \
+                size_t n = get_f64vec_length(dd.vec[0]);                \
+                struct datum *rv = make_f64vec(n);                      \
+                kernel(get_f64vec_data(rv), get_f64vec_data(dd.vec[0]), \
+                       get_f64vec_data(dd.vec[1]), n);                  \
+                return rv;                                              \
+        }
+F64VEC_BINOP(ADD, "F64VEC-ADD", f64_add)
+F64VEC_BINOP(SUB, "F64VEC-SUB", f64_sub)
+F64VEC_BINOP(MUL, "F64VEC-MUL", f64_mul)
+F64VEC_BINOP(DIV, "F64VEC-DIV", f64_div)
+
+static struct datum *prim_F64VEC_SCALE(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 2, 1, "F64VEC-SCALE");
+        if (!is_number(dd.vec[1])) raise_error(d, "F64VEC-SCALE: type error");
+        size_t n = get_f64vec_length(dd.vec[0]);
+        struct datum *rv = make_f64vec(n);
+        f64_scale(get_f64vec_data(rv), get_f64vec_data(dd.vec[0]),
+                  get_numeric_value(dd.vec[1]), n);
+        return rv;
+}
+
+static struct datum *prim_F64VEC_DOT(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 2, 2, "F64VEC-DOT");
+        return make_numeric_atom(f64_dot(get_f64vec_data(dd.vec[0]),
+                                         get_f64vec_data(dd.vec[1]),
+                                         get_f64vec_length(dd.vec[0])));
+}
+
+static struct datum *prim_F64VEC_SUM(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 1, 1, "F64VEC-SUM");
+        return make_numeric_atom(f64_sum(get_f64vec_data(dd.vec[0]),
+                                         get_f64vec_length(dd.vec[0])));
+}
+
+#define F64VEC_MINMAX(NAME, name, kernel)                               \
+        static struct datum *prim_F64VEC_##NAME(struct datum *d)        \
+        {                                                               \
+                struct list_data dd = f64vec_args(d, 1, 1, name);       \
+                size_t n = get_f64vec_length(dd.vec[0]);                \
+                if (n == 0) raise_error(d, "%s: empty vector", name);   \
+                return make_numeric_atom(kernel(get_f64vec_data(dd.vec[0]), \
+                                                n));                    \
+        }
+F64VEC_MINMAX(MIN, "F64VEC-MIN", f64_min)
+F64VEC_MINMAX(MAX, "F64VEC-MAX", f64_max)
+
+static struct datum *prim_F64VEC_PREFIX_SUM(struct datum *d)
+{
+        struct list_data dd = f64vec_args(d, 1, 1, "F64VEC-PREFIX-SUM");
+        size_t n = get_f64vec_length(dd.vec[0]);
+        struct datum *rv = make_f64vec(n);
+        f64_prefix_sum(get_f64vec_data(rv), get_f64vec_data(dd.vec[0]), n);
+        return rv;
+}
+
+
+
+
+/* Fast paths (see fast_fun in data.h). */
+
+static struct datum *fast_ADD(struct datum *a, struct datum *b)
+{
+        if (!is_number(a) || !is_number(b)) return NULL;
+        return number_add(a, b);
+}
+
+static struct datum *fast_SUB(struct datum *a, struct datum *b)
+{
+        if (!is_number(a) || !is_number(b)) return NULL;
+        return number_sub(a, b);
+}
+
+static struct datum *fast_MUL(struct datum *a, struct datum *b)
+{
+        if (!is_number(a) || !is_number(b)) return NULL;
+        return number_mul(a, b);
+}
+
+static struct datum *fast_DIV(struct datum *a, struct datum *b)
+{
+        if (!is_number(a) || !is_number(b)) return NULL;
+        return number_div(a, b);
+}
+
+static struct datum *fast_CONS(struct datum *a, struct datum *b)
+{
+        return make_pair(a, b);
+}
+
+static struct datum *fast_CAR(struct datum *a, struct datum *b)
+{
+        (void)b;
+        if (get_type(a) != T_PAIR) return NULL;
+        return get_pair_first(a);
+}
+
+static struct datum *fast_CDR(struct datum *a, struct datum *b)
+{
+        (void)b;
+        if (get_type(a) != T_PAIR) return NULL;
+        return get_pair_second(a);
+}
+
+static const struct {
+        const char *name;
+        size_t argc;
+        fast_fun fast;
+} fast_prims[] = {
+        { "ADD", 2, fast_ADD },
+        { "SUB", 2, fast_SUB },
+        { "MUL", 2, fast_MUL },
+        { "DIV", 2, fast_DIV },
+        { "CONS", 2, fast_CONS },
+        { "CAR", 1, fast_CAR },
+        { "CDR", 1, fast_CDR },
+};
 
 struct primop {
         const char *name;
@@ -186,22 +1073,162 @@ struct primop {
 };
 static const struct primop primops[] = {
         { "EQ", prim_EQ },
+        { "EQUAL", prim_EQUAL },
         { "ATOM", prim_ATOM },
         { "CONS", prim_CONS },
         { "CAR", prim_CAR },
         { "CDR", prim_CDR },
+        { "LENGTH", prim_LENGTH },
+        { "APPEND", prim_APPEND },
+        { "REVERSE", prim_REVERSE },
+        { "NTH", prim_NTH },
+        { "LAST", prim_LAST },
+        { "MEMBER", prim_MEMBER },
+        { "ASSOC", prim_ASSOC },
+        { "MAP", prim_MAP },
+        { "FILTER", prim_FILTER },
+        { "FOLD", prim_FOLD },
+        { "SORT", prim_SORT },
+        { "FORCE", prim_FORCE },
+        { "STREAM-CONS", prim_STREAM_CONS },
+        { "STREAM-CAR", prim_STREAM_CAR },
+        { "STREAM-CDR", prim_STREAM_CDR },
+        { "STREAM-MAP", prim_STREAM_MAP },
+        { "STREAM-FILTER", prim_STREAM_FILTER },
+        { "STREAM-TAKE", prim_STREAM_TAKE },
         { "ADD", prim_ADD },
         { "SUB", prim_SUB },
         { "MUL", prim_MUL },
         { "DIV", prim_DIV },
         { "PRINT", prim_PRINT },
+        { "HEAP-PROFILE", prim_HEAP_PROFILE },
+        { "READ", prim_READ },
+        { "READ-FROM", prim_READ_FROM },
+        { "EOF-P", prim_EOF_P },
+        { "MAKE-HASH", prim_MAKE_HASH },
+        { "HASH-GET", prim_HASH_GET },
+        { "HASH-PUT", prim_HASH_PUT },
+        { "HASH-DEL", prim_HASH_DEL },
+        { "HASH-COUNT", prim_HASH_COUNT },
+        { "HASH-KEYS", prim_HASH_KEYS },
+        { "HASH-ALIST", prim_HASH_ALIST },
+        { "VECTOR", prim_VECTOR },
+        { "LIST-TO-VECTOR", prim_LIST_TO_VECTOR },
+        { "VECTOR-TO-LIST", prim_VECTOR_TO_LIST },
+        { "VLENGTH", prim_VLENGTH },
+        { "VREF", prim_VREF },
+        { "VSET", prim_VSET },
+        { "VPUSH", prim_VPUSH },
+        { "F64VEC", prim_F64VEC },
+        { "LIST-TO-F64VEC", prim_LIST_TO_F64VEC },
+        { "F64VEC-TO-LIST", prim_F64VEC_TO_LIST },
+        { "F64VEC-LENGTH", prim_F64VEC_LENGTH },
+        { "F64VEC-REF", prim_F64VEC_REF },
+        { "F64VEC-ADD", prim_F64VEC_ADD },
+        { "F64VEC-SUB", prim_F64VEC_SUB },
+        { "F64VEC-MUL", prim_F64VEC_MUL },
+        { "F64VEC-DIV", prim_F64VEC_DIV },
+        { "F64VEC-SCALE", prim_F64VEC_SCALE },
+        { "F64VEC-DOT", prim_F64VEC_DOT },
+        { "F64VEC-SUM", prim_F64VEC_SUM },
+        { "F64VEC-MIN", prim_F64VEC_MIN },
+        { "F64VEC-MAX", prim_F64VEC_MAX },
+        { "F64VEC-PREFIX-SUM", prim_F64VEC_PREFIX_SUM },
 };
 
+#define NUM_PRIMOPS (sizeof primops / sizeof *primops)
+
 struct env *get_primops_env(void)
 {
         struct env *rv = make_empty_env();
-        for (size_t i = 0; i < sizeof primops / sizeof *primops; i++) {
+        for (size_t i = 0; i < NUM_PRIMOPS; i++) {
                 env_bind(rv, primops[i].name, make_primitive(primops[i].fun));
         }
+        register_compiled_primops(rv);
         return rv;
 }
+
+static const struct primop *find_primop(const char *name)
+{
+        for (size_t i = 0; i < NUM_PRIMOPS; i++) {
+                if (strcasecmp(primops[i].name, name) == 0) {
+                        return &primops[i];
+                }
+        }
+        return NULL;
+}
+
+prim_fun get_primop(const char *name)
+{
+        const struct primop *p = find_primop(name);
+        return p != NULL ? p->fun : NULL;
+}
+
+const char *get_primop_name(prim_fun fun)
+{
+        for (size_t i = 0; i < NUM_PRIMOPS; i++) {
+                if (primops[i].fun == fun) return primops[i].name;
+        }
+        return NULL;
+}
+
+fast_fun get_primop_fast(const char *name, size_t argc)
+{
+        for (size_t i = 0; i < sizeof fast_prims / sizeof *fast_prims; i++) {
+                if (fast_prims[i].argc == argc &&
+                    strcasecmp(fast_prims[i].name, name) == 0) {
+                        return fast_prims[i].fast;
+                }
+        }
+        return NULL;
+}
+
+static _Bool rebound[NUM_PRIMOPS];
+
+/* note_primop_binding is called on every binding, so names are first
+   filtered by their initial and length: bit k of name_lengths[c] is
+   set if some primitive name of length k begins with c. */
+#define MAX_FILTERED_LENGTH 31
+static uint32_t name_lengths[UCHAR_MAX + 1];
+static _Bool name_lengths_ready = 0;
+
+static void init_name_lengths(void)
+{
+        name_lengths_ready = 1;
+        for (size_t i = 0; i < NUM_PRIMOPS; i++) {
+                size_t len = strlen(primops[i].name);
+                unsigned char c = primops[i].name[0];
+                if (len > MAX_FILTERED_LENGTH) len = MAX_FILTERED_LENGTH;
+                name_lengths[toupper(c)] |= (uint32_t)1 << len;
+                name_lengths[tolower(c)] |= (uint32_t)1 << len;
+        }
+}
+
+void note_primop_binding(const char *name, struct datum *binding)
+{
+        if (!name_lengths_ready) init_name_lengths();
+        size_t len = 0;
+        while (len < MAX_FILTERED_LENGTH && name[len] != '\0') len++;
+        if (!(name_lengths[(unsigned char)name[0]] & (uint32_t)1 << len)) {
+                return;
+        }
+        const struct primop *p = find_primop(name);
+        if (p == NULL) return;
+        if (binding != NULL && get_type(binding) == T_PRIMITIVE &&
+            get_primitive_fun(binding) == p->fun) {
+                return;
+        }
+        rebound[p - primops] = 1;
+}
+
+const _Bool *get_primop_rebound_flag(const char *name)
+{
+        const struct primop *p = find_primop(name);
+        return p != NULL ? &rebound[p - primops] : NULL;
+}
+
+WEAK(void register_compiled_primops(struct env *env));
+void register_compiled_primops(struct env *env)
+{
+        (void)env;
+}
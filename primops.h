@@ -33,4 +33,36 @@
 
 struct env *get_primops_env(void);
 
+/* Returns the C function implementing the named primitive, or NULL if
+   there is no such primitive. */
+prim_fun get_primop(const char *name);
+
+/* Returns the name of the primitive implemented by fun, or NULL if it
+   is not one of the built-in primitives. */
+const char *get_primop_name(prim_fun fun);
+
+/* Returns the fast path of the named primitive for argc arguments, or
+   NULL if there is none. */
+fast_fun get_primop_fast(const char *name, size_t argc);
+
+/* Calls can be specialized to the primitive their operator names, so
+   that the name need not be looked up every time (see quicken in
+   eval.c and run_app_prim in compile.c).  That is only safe while no
+   environment binds the name to anything else, so every binding is
+   reported here: by env_bind, and by the parser for the parameters of
+   a lambda, which may be bound in argument frames.  binding is NULL if
+   it is not known yet.
+
+   Once the name of a primitive has been bound to something other than
+   the primitive, even locally, the flag returned by
+   get_primop_rebound_flag is set for good.  The flag pointer is NULL
+   if there is no such primitive. */
+void note_primop_binding(const char *name, struct datum *binding);
+const _Bool *get_primop_rebound_flag(const char *name);
+
+/* Binds the functions of a C file generated by --compile-to-c.  The
+   default definition does nothing; a generated file linked into the
+   interpreter replaces it. */
+void register_compiled_primops(struct env *);
+
 #endif /* GUARD_PRIMOPS_H */
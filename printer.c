@@ -26,44 +26,121 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
+#include <inttypes.h>
+#include <string.h>
 #include <strings.h>
+#include "alloc.h"
+#include "bignum.h"
 #include "error.h"
+#include "hash.h"
 #include "printer.h"
+#include "pvec.h"
 
-void print_sexp(struct datum *d, FILE *fp)
+static void print_atom(struct datum *d, FILE *fp)
 {
         switch (get_type(d)) {
-        case T_CLOSURE:
-                fputs("#<closure>", fp);
-                print_sexp(get_closure_fun(d), fp);
-                return;
-        case T_ERROR:
-                fputs("#<error>", fp);
-                goto pair;
-        pair: case T_PAIR:
-                fputc('(', fp);
-                print_sexp(get_pair_first(d), fp);
-                d = get_pair_second(d);
-                while (get_type(d) == T_PAIR) {
-                        fputc(' ', fp);
-                        print_sexp(get_pair_first(d), fp);
-                        d = get_pair_second(d);
-                }
-                if (!is_NIL(d)) {
-                        fputs(" . ", fp);
-                        print_sexp(d, fp);
-                }
-                fputc(')', fp);
-                return;
         case T_NUMBER:
                 fprintf(fp, "%lg", get_numeric_value(d));
                 return;
+        case T_INTEGER:
+                if (is_fixnum(d)) {
+                        fprintf(fp, "%" PRId64, get_fixnum_value(d));
+                } else {
+                        fputs(bignum_to_decimal(get_bignum_value(d)), fp);
+                }
+                return;
         case T_SYMBOL:
                 fputs(get_symbol_name(d), fp);
                 return;
         case T_PRIMITIVE:
                 fputs("#<primitive>", fp);
                 return;
+        case T_HASH:
+                fprintf(fp, "#<hash %zu>", hash_count(get_hash_table(d)));
+                return;
+        case T_F64VEC:
+                fprintf(fp, "#<f64vec %zu>", get_f64vec_length(d));
+                return;
+        case T_PROMISE:
+                fputs("#<promise>", fp);
+                return;
+        case T_PAIR: case T_CLOSURE: case T_ERROR: case T_VECTOR:
+                break;
         }
         NOTREACHED;
 }
+
+void print_sexp(struct datum *d, FILE *fp)
+{
+        // The stack holds, for each list being printed, the rest of
+        // it after the element being printed; NIL once a dotted tail
+        // has been started.  Starts in this frame, moves to the heap.
+        struct datum *local[32];
+        struct datum **stack = local;
+        size_t n = 0, cap = sizeof local / sizeof *local;
+        for (;;) {
+                switch (get_type(d)) {
+                case T_CLOSURE:
+                        fputs("#<closure>", fp);
+                        d = get_closure_fun(d);
+                        continue;
+                case T_ERROR:
+                        fputs("#<error>", fp);
+                        // fall through
+                case T_PAIR:
+                        fputc('(', fp);
+                        if (n == cap) {
+                                struct datum **s =
+                                        alloc_object(2 * cap * sizeof *s);
+                                memcpy(s, stack, n * sizeof *s);
+                                stack = s;
+                                cap *= 2;
+                        }
+                        stack[n++] = get_pair_second(d);
+                        d = get_pair_first(d);
+                        continue;
+                case T_VECTOR:
+                        fputc('#', fp);
+                        if (pvec_length(get_vector(d)) > 0) {
+                                d = vector_to_list(d);
+                                continue;
+                        }
+                        fputs("()", fp);
+                        break;
+                default:
+                        print_atom(d, fp);
+                        break;
+                }
+                for (;;) {
+                        if (n == 0) return;
+                        struct datum *rest = stack[n - 1];
+                        if (get_type(rest) == T_PAIR) {
+                                fputc(' ', fp);
+                                stack[n - 1] = get_pair_second(rest);
+                                d = get_pair_first(rest);
+                                break;
+                        }
+                        if (!is_NIL(rest)) {
+                                fputs(" . ", fp);
+                                stack[n - 1] = make_NIL();
+                                d = rest;
+                                break;
+                        }
+                        fputc(')', fp);
+                        n--;
+                }
+        }
+}
+
+void print_error(struct datum *d, FILE *fp)
+{
+        print_sexp(d, fp);
+        fputc('\n', fp);
+        for (struct datum *it = get_error_backtrace(d);
+             get_type(it) == T_PAIR;
+             it = get_pair_second(it)) {
+                fputs("  in ", fp);
+                print_sexp(get_pair_first(it), fp);
+                fputc('\n', fp);
+        }
+}
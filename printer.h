@@ -34,4 +34,7 @@
 
 void print_sexp(struct datum *, FILE *fp);
 
+// prints an error value followed by its backtrace, one call per line
+void print_error(struct datum *, FILE *fp);
+
 #endif /* GUARD_PRINTER_H */
@@ -0,0 +1,149 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <string.h>
+
+#include "alloc.h"
+#include "pvec.h"
+
+#define BITS 5
+#define WIDTH (1 << BITS)
+#define MASK (WIDTH - 1)
+
+/* Inner nodes point to nodes, leaves to data.  Unused slots are
+   NULL. */
+struct node {
+        void *slot[WIDTH];
+};
+
+struct pvec {
+        size_t n;
+        unsigned shift;         // BITS times the height of the trie
+        struct node *root;
+};
+
+static struct node *new_node(void)
+{
+        return alloc_object(sizeof(struct node));
+}
+
+static struct node *copy_node(const struct node *nd)
+{
+        struct node *rv = new_node();
+        if (nd != NULL) memcpy(rv, nd, sizeof *rv);
+        return rv;
+}
+
+static struct pvec *new_pvec(size_t n, unsigned shift, struct node *root)
+{
+        struct pvec *rv = alloc_object(sizeof *rv);
+        rv->n = n;
+        rv->shift = shift;
+        rv->root = root;
+        return rv;
+}
+
+struct pvec *pvec_from_array(struct datum *const *elems, size_t n)
+{
+        // fill the leaves, then build each level above from the one
+        // below until a single node is left
+        size_t count = n > 0 ? (n + MASK) / WIDTH : 1;
+        struct node **level = alloc_object(count * sizeof *level);
+        for (size_t i = 0; i < count; i++) {
+                level[i] = new_node();
+                size_t len = n - i * WIDTH < WIDTH ? n - i * WIDTH : WIDTH;
+                if (n > 0) memcpy(level[i]->slot, elems + i * WIDTH,
+                                  len * sizeof *elems);
+        }
+        alloc_keep_alive(elems);
+        unsigned shift = 0;
+        while (count > 1) {
+                size_t up = (count + MASK) / WIDTH;
+                for (size_t i = 0; i < up; i++) {
+                        struct node *nd = new_node();
+                        for (size_t j = 0; j < WIDTH && i * WIDTH + j < count;
+                             j++) {
+                                nd->slot[j] = level[i * WIDTH + j];
+                        }
+                        level[i] = nd;
+                }
+                count = up;
+                shift += BITS;
+        }
+        alloc_keep_alive(level);
+        return new_pvec(n, shift, level[0]);
+}
+
+size_t pvec_length(const struct pvec *v)
+{
+        return v->n;
+}
+
+struct datum *pvec_ref(const struct pvec *v, size_t i)
+{
+        const struct node *nd = v->root;
+        for (unsigned s = v->shift; s > 0; s -= BITS) {
+                nd = nd->slot[(i >> s) & MASK];
+        }
+        return nd->slot[i & MASK];
+}
+
+/* Copies the path from root to slot i, creating missing nodes, and
+   stores d in the slot. */
+static struct node *set_path(const struct node *root, unsigned shift,
+                             size_t i, struct datum *d)
+{
+        struct node *rv = copy_node(root);
+        struct node *nd = rv;
+        for (unsigned s = shift; s > 0; s -= BITS) {
+                size_t k = (i >> s) & MASK;
+                nd->slot[k] = copy_node(nd->slot[k]);
+                nd = nd->slot[k];
+        }
+        nd->slot[i & MASK] = d;
+        return rv;
+}
+
+struct pvec *pvec_set(const struct pvec *v, size_t i, struct datum *d)
+{
+        return new_pvec(v->n, v->shift, set_path(v->root, v->shift, i, d));
+}
+
+struct pvec *pvec_push(const struct pvec *v, struct datum *d)
+{
+        struct node *root = v->root;
+        unsigned shift = v->shift;
+        if (v->n == (size_t)WIDTH << shift) {
+                // full: the old trie becomes the first child of a new root
+                struct node *nd = new_node();
+                nd->slot[0] = root;
+                root = nd;
+                shift += BITS;
+        }
+        return new_pvec(v->n + 1, shift, set_path(root, shift, v->n, d));
+}
@@ -0,0 +1,58 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+ 
+#ifndef GUARD_PVEC_H
+#define GUARD_PVEC_H
+
+#include <stddef.h>
+
+struct datum;
+
+/* Persistent vectors: immutable arrays of data in which an update
+   returns a new vector sharing all but one path with the old one.
+
+   A vector is a trie of 32-way nodes whose leaves hold the elements,
+   so indexing, updating and appending take O(log32 n) steps, which is
+   at most a handful for any vector that fits in memory. */
+struct pvec;
+
+struct pvec *pvec_from_array(struct datum *const *elems, size_t n);
+
+size_t pvec_length(const struct pvec *);
+
+/* i must be less than the length. */
+struct datum *pvec_ref(const struct pvec *, size_t i);
+
+/* Returns a copy with element i replaced; i must be less than the
+   length. */
+struct pvec *pvec_set(const struct pvec *, size_t i, struct datum *);
+
+/* Returns a copy with the datum appended. */
+struct pvec *pvec_push(const struct pvec *, struct datum *);
+
+#endif /* GUARD_PVEC_H */
@@ -0,0 +1,179 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "alloc.h"
+#include "data.h"
+#include "error.h"
+#include "lexer.h"
+#include "reader.h"
+
+enum frame_kind {
+        F_LIST,                 /* reading the elements of a list */
+        F_VECTOR,               /* reading the elements of a vector */
+        F_DOT,                  /* read a '.' and wait for the tail */
+        F_DOTTED,               /* read the tail and wait for ')' */
+        F_QUOTE                 /* read a '\'' and wait for its operand */
+};
+
+struct frame {
+        enum frame_kind kind;
+        struct datum *head;     /* NULL for an empty list */
+        struct datum *tail;     /* last pair of the list */
+        size_t line, col;       /* where the frame was opened */
+};
+
+struct stack {
+        struct frame *frames;
+        size_t n, cap;
+};
+
+static struct frame *push(struct stack *st, struct lexer *lx,
+                          enum frame_kind kind)
+{
+        if (st->n == st->cap) {
+                st->cap = st->cap > 0 ? 2 * st->cap : 32;
+                st->frames = alloc_realloc(st->frames,
+                                           st->cap * sizeof *st->frames);
+        }
+        struct frame *f = &st->frames[st->n++];
+        f->kind = kind;
+        f->head = f->tail = NULL;
+        f->line = lexer_line(lx);
+        f->col = lexer_column(lx);
+        return f;
+}
+
+static struct datum *syntax_error(struct lexer *lx, size_t line, size_t col,
+                                  const char *msg)
+{
+        int n = snprintf(NULL, 0, "%s:%zu:%zu", lexer_name(lx), line, col);
+        char *where = alloc_atomic(n + 1);
+        snprintf(where, n + 1, "%s:%zu:%zu", lexer_name(lx), line, col);
+        return make_error(make_symbolic_atom(where, n), "%s", msg);
+}
+
+enum read_status read_datum(struct lexer *lx, struct datum **out)
+{
+        struct stack st = { NULL, 0, 0 };
+        for (;;) {
+                struct datum *d = NULL;
+                struct frame *top = st.n > 0 ? &st.frames[st.n - 1] : NULL;
+                switch (lexer_next(lx, &d)) {
+                case TOK_EOF:
+                        if (top == NULL) return READ_EOF;
+                        *out = syntax_error(lx, top->line, top->col,
+                                            top->kind == F_QUOTE
+                                            ? "End of input after quote"
+                                            : "Unclosed parenthesis");
+                        return READ_ERROR;
+                case TOK_OPEN:
+                        push(&st, lx, F_LIST);
+                        continue;
+                case TOK_OPEN_VECTOR:
+                        push(&st, lx, F_VECTOR);
+                        continue;
+                case TOK_QUOTE:
+                        push(&st, lx, F_QUOTE);
+                        continue;
+                case TOK_DOT:
+                        if (top == NULL || top->kind != F_LIST
+                            || top->head == NULL) {
+                                *out = syntax_error(lx, lexer_line(lx),
+                                                    lexer_column(lx),
+                                                    "Unexpected dot");
+                                return READ_ERROR;
+                        }
+                        top->kind = F_DOT;
+                        continue;
+                case TOK_CLOSE:
+                        if (top == NULL || top->kind == F_QUOTE
+                            || top->kind == F_DOT) {
+                                *out = syntax_error(lx, lexer_line(lx),
+                                                    lexer_column(lx),
+                                                    "Unexpected closing "
+                                                    "parenthesis");
+                                return READ_ERROR;
+                        }
+                        d = top->head != NULL ? top->head : make_NIL();
+                        if (top->kind == F_VECTOR) d = make_vector_from_list(d);
+                        st.n--;
+                        break;
+                case TOK_ATOM:
+                        break;
+                }
+
+                // d is complete; hand it to the enclosing frames
+                for (;;) {
+                        if (st.n == 0) {
+                                *out = d;
+                                return READ_OK;
+                        }
+                        top = &st.frames[st.n - 1];
+                        if (top->kind != F_QUOTE) break;
+                        d = make_pair(make_QUOTE(), make_pair(d, make_NIL()));
+                        st.n--;
+                }
+                switch (top->kind) {
+                case F_LIST: case F_VECTOR:
+                {
+                        struct datum *p = make_pair(d, make_NIL());
+                        if (top->head == NULL) {
+                                top->head = p;
+                        } else {
+                                set_pair_second(top->tail, p);
+                        }
+                        top->tail = p;
+                        break;
+                }
+                case F_DOT:
+                        set_pair_second(top->tail, d);
+                        top->kind = F_DOTTED;
+                        break;
+                case F_DOTTED:
+                        *out = syntax_error(lx, lexer_line(lx),
+                                            lexer_column(lx),
+                                            "Expected closing parenthesis "
+                                            "after dotted tail");
+                        return READ_ERROR;
+                case F_QUOTE:
+                        NOTREACHED;
+                }
+        }
+}
+
+enum read_status read_from_string(const char *s, size_t len,
+                                  struct datum **out)
+{
+        struct lexer *lx = lexer_new_string(s, len, "<string>");
+        enum read_status rv = read_datum(lx, out);
+        lexer_free(lx);
+        return rv;
+}
@@ -26,12 +26,155 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
-extern int yyparse();
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-extern int yydebug;
+#include "alloc.h"
+#include "compile_c.h"
+#include "data.h"
+#include "eval.h"
+#include "heap_profile.h"
+#include "lexer.h"
+#include "printer.h"
+#include "reader.h"
+#include "timeline.h"
 
-int main(void)
+static void usage(void)
 {
-        yydebug=1;
-        yyparse();
+        fputs("Usage: simple-lisp [--engine=tree|--engine=compiled]\n"
+              "                   [--trace FILE [--trace-sample=N]"
+              " [--trace-min-us=N]]\n"
+              "                   [--heap-profile [--heap-profile-sample=N]]\n"
+              "                   [--max-steps=N] [--max-heap-growth=BYTES]"
+              " [--max-time-ms=N]\n"
+              "       simple-lisp --compile-to-c FILE\n", stderr);
+        exit(EXIT_FAILURE);
+}
+
+/* Returns the number written in s, or calls usage if there is none. */
+static unsigned long option_number(const char *s)
+{
+        char *end;
+        unsigned long n = strtoul(s, &end, 10);
+        if (*s < '0' || *s > '9' || *end != '\0') usage();
+        return n;
+}
+
+static void on_interrupt(int sig)
+{
+        signal(sig, on_interrupt);
+        eval_interrupt();
+}
+
+/* Evaluates every form read and prints its value.  An interrupt
+   aborts the evaluation in progress. */
+static void session(struct lexer *lx)
+{
+        signal(SIGINT, on_interrupt);
+        for (;;) {
+                struct datum *d;
+                switch (read_datum(lx, &d)) {
+                case READ_EOF:
+                        return;
+                case READ_ERROR:
+                        print_error(d, stdout);
+                        lexer_skip_line(lx);
+                        continue;
+                case READ_OK:
+                        break;
+                }
+                struct datum *rv = eval(d);
+                if (get_type(rv) == T_ERROR) {
+                        print_error(rv, stdout);
+                } else {
+                        print_sexp(rv, stdout);
+                        putchar('\n');
+                }
+        }
+}
+
+/* Passes every form read to handle.  Returns false on a syntax error. */
+static _Bool script(struct lexer *lx, void (*handle)(struct datum *))
+{
+        for (;;) {
+                struct datum *d;
+                switch (read_datum(lx, &d)) {
+                case READ_EOF:
+                        return 1;
+                case READ_ERROR:
+                        print_error(d, stderr);
+                        return 0;
+                case READ_OK:
+                        handle(d);
+                        break;
+                }
+        }
+}
+
+static void eval_script_form(struct datum *d)
+{
+        struct datum *rv = eval(d);
+        if (get_type(rv) == T_ERROR) print_error(rv, stderr);
+}
+
+int main(int argc, char *argv[])
+{
+        alloc_init();
+        if (argc == 3 && strcmp(argv[1], "--compile-to-c") == 0) {
+                FILE *fp = fopen(argv[2], "r");
+                if (fp == NULL) {
+                        perror(argv[2]);
+                        return EXIT_FAILURE;
+                }
+                if (!script(lexer_new_file(fp, argv[2]), compile_c_form)) {
+                        return EXIT_FAILURE;
+                }
+                compile_c_finish(stdout, argv[2]);
+                return EXIT_SUCCESS;
+        }
+        const char *trace = NULL;
+        unsigned long trace_sample = 1, trace_min_us = 0;
+        _Bool heap_profile = 0;
+        unsigned long max_steps = 0, max_heap = 0, max_ms = 0;
+        unsigned long heap_sample = 1;
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "--engine=tree") == 0) {
+                        set_eval_engine(ENGINE_TREE);
+                } else if (strcmp(argv[i], "--engine=compiled") == 0) {
+                        set_eval_engine(ENGINE_COMPILED);
+                } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+                        trace = argv[++i];
+                } else if (strncmp(argv[i], "--trace-sample=", 15) == 0) {
+                        trace_sample = option_number(argv[i] + 15);
+                        if (trace_sample == 0) usage();
+                } else if (strncmp(argv[i], "--trace-min-us=", 15) == 0) {
+                        trace_min_us = option_number(argv[i] + 15);
+                } else if (strcmp(argv[i], "--heap-profile") == 0) {
+                        heap_profile = 1;
+                } else if (strncmp(argv[i], "--heap-profile-sample=",
+                                   22) == 0) {
+                        heap_sample = option_number(argv[i] + 22);
+                        if (heap_sample == 0) usage();
+                } else if (strncmp(argv[i], "--max-steps=", 12) == 0) {
+                        max_steps = option_number(argv[i] + 12);
+                } else if (strncmp(argv[i], "--max-heap-growth=", 18) == 0) {
+                        max_heap = option_number(argv[i] + 18);
+                } else if (strncmp(argv[i], "--max-time-ms=", 14) == 0) {
+                        max_ms = option_number(argv[i] + 14);
+                } else {
+                        usage();
+                }
+        }
+        if (trace != NULL) timeline_start(trace, trace_sample, trace_min_us);
+        if (heap_profile) heap_profile_start(heap_sample);
+        set_eval_limits(max_steps, max_heap, max_ms);
+        if (isatty(STDIN_FILENO)) {
+                session(standard_input());
+                return EXIT_SUCCESS;
+        }
+        return script(standard_input(), eval_script_form)
+                ? EXIT_SUCCESS : EXIT_FAILURE;
 }
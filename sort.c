@@ -0,0 +1,231 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "alloc.h"
+#include "sort.h"
+
+enum {
+        INSERTION_RUN = 16,     // runs this short are sorted by insertion
+        MIN_PER_THREAD = 8192,  // smaller pieces are not worth a thread
+        MAX_THREADS = 64,
+};
+
+struct task {
+        sort_less *less;
+        void *arg;
+        // a sort of v[0..n), using tmp[0..n) as scratch
+        struct datum **v, **tmp;
+        size_t n;
+        // or, if out is set, a merge of a[0..na) and b[0..nb) into out
+        struct datum **a, **b, **out;
+        size_t na, nb;
+};
+
+static void merge(sort_less *less, void *arg,
+                  struct datum **a, size_t na,
+                  struct datum **b, size_t nb, struct datum **out)
+{
+        size_t i = 0, j = 0;
+        while (i < na && j < nb) {
+                // on ties, the element of a comes first
+                if (less(b[j], a[i], arg)) {
+                        *out++ = b[j++];
+                } else {
+                        *out++ = a[i++];
+                }
+        }
+        memcpy(out, a + i, (na - i) * sizeof *out);
+        memcpy(out + (na - i), b + j, (nb - j) * sizeof *out);
+}
+
+static void sort_run(sort_less *less, void *arg,
+                     struct datum **v, struct datum **tmp, size_t n)
+{
+        for (size_t lo = 0; lo < n; lo += INSERTION_RUN) {
+                size_t hi = lo + INSERTION_RUN < n ? lo + INSERTION_RUN : n;
+                for (size_t i = lo + 1; i < hi; i++) {
+                        struct datum *x = v[i];
+                        size_t j = i;
+                        while (j > lo && less(x, v[j - 1], arg)) {
+                                v[j] = v[j - 1];
+                                j--;
+                        }
+                        v[j] = x;
+                }
+        }
+        struct datum **src = v, **dst = tmp;
+        for (size_t w = INSERTION_RUN; w < n; w *= 2) {
+                for (size_t lo = 0; lo < n; lo += 2 * w) {
+                        size_t mid = lo + w < n ? lo + w : n;
+                        size_t hi = mid + w < n ? mid + w : n;
+                        merge(less, arg, src + lo, mid - lo,
+                              src + mid, hi - mid, dst + lo);
+                }
+                struct datum **t = src;
+                src = dst;
+                dst = t;
+        }
+        if (src != v) memcpy(v, src, n * sizeof *v);
+}
+
+static void *run_task(void *p)
+{
+        struct task *t = p;
+        if (t->out != NULL) {
+                merge(t->less, t->arg, t->a, t->na, t->b, t->nb, t->out);
+        } else {
+                sort_run(t->less, t->arg, t->v, t->tmp, t->n);
+        }
+        return NULL;
+}
+
+/* Runs the tasks, all but the first in threads of their own.  A task
+   whose thread cannot be created is run here instead. */
+static void run_tasks(struct task *t, size_t n)
+{
+        pthread_t thread[MAX_THREADS + 1];
+        _Bool started[MAX_THREADS + 1];
+        for (size_t i = 1; i < n; i++) {
+                started[i] = pthread_create(&thread[i], NULL,
+                                            run_task, &t[i]) == 0;
+        }
+        run_task(&t[0]);
+        for (size_t i = 1; i < n; i++) {
+                if (started[i]) {
+                        pthread_join(thread[i], NULL);
+                } else {
+                        run_task(&t[i]);
+                }
+        }
+}
+
+/* The number of elements of b that must come before x. */
+static size_t lower_bound(sort_less *less, void *arg,
+                          struct datum **b, size_t nb, struct datum *x)
+{
+        size_t lo = 0, hi = nb;
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (less(b[mid], x, arg)) {
+                        lo = mid + 1;
+                } else {
+                        hi = mid;
+                }
+        }
+        return lo;
+}
+
+/* Adds k tasks that together merge a and b into out: a is cut into k
+   equal parts, and b where each part of a begins. */
+static size_t split_merge(struct task *t, sort_less *less, void *arg,
+                          struct datum **a, size_t na,
+                          struct datum **b, size_t nb,
+                          struct datum **out, size_t k)
+{
+        size_t i0 = 0, j0 = 0;
+        for (size_t s = 1; s <= k; s++) {
+                size_t i = s == k ? na : na * s / k;
+                size_t j = s == k ? nb : lower_bound(less, arg, b, nb, a[i]);
+                t[s - 1] = (struct task){
+                        .less = less, .arg = arg,
+                        .a = a + i0, .na = i - i0,
+                        .b = b + j0, .nb = j - j0,
+                        .out = out + i0 + j0,
+                };
+                i0 = i;
+                j0 = j;
+        }
+        return k;
+}
+
+static size_t thread_count(size_t n)
+{
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        size_t k = ncpu > 0 ? (size_t)ncpu : 1;
+        if (k > MAX_THREADS) k = MAX_THREADS;
+        if (k > n / MIN_PER_THREAD) k = n / MIN_PER_THREAD;
+        return k > 0 ? k : 1;
+}
+
+void sort_data(struct datum **v, size_t n, sort_less *less, void *arg,
+               _Bool parallel)
+{
+        if (n < 2) return;
+        // During a merge, some elements are only in the scratch array,
+        // so it must be scanned if the comparison may allocate (and
+        // so collect), which it may only if parallel is unset.
+        struct datum **tmp = parallel ? alloc_atomic(n * sizeof *tmp)
+                                      : alloc_object(n * sizeof *tmp);
+        size_t k = parallel ? thread_count(n) : 1;
+        if (k == 1) {
+                sort_run(less, arg, v, tmp, n);
+                alloc_keep_alive(tmp);
+                return;
+        }
+
+        // sort k pieces, then merge pairs of runs until one is left,
+        // giving each merge an equal share of the k threads
+        struct task t[MAX_THREADS + 1];
+        size_t bound[MAX_THREADS + 1];
+        for (size_t i = 0; i <= k; i++) bound[i] = n * i / k;
+        for (size_t i = 0; i < k; i++) {
+                t[i] = (struct task){
+                        .less = less, .arg = arg,
+                        .v = v + bound[i], .tmp = tmp + bound[i],
+                        .n = bound[i + 1] - bound[i],
+                };
+        }
+        run_tasks(t, k);
+
+        struct datum **src = v, **dst = tmp;
+        for (size_t runs = k; runs > 1; runs = (runs + 1) / 2) {
+                size_t pairs = runs / 2;
+                size_t share = k / pairs;
+                size_t ntasks = 0;
+                for (size_t p = 0; p < runs; p += 2) {
+                        size_t lo = bound[p];
+                        size_t mid = bound[p + 1];
+                        size_t hi = p + 2 <= runs ? bound[p + 2] : mid;
+                        ntasks += split_merge(t + ntasks, less, arg,
+                                              src + lo, mid - lo,
+                                              src + mid, hi - mid,
+                                              dst + lo,
+                                              p + 1 < runs ? share : 1);
+                        bound[p / 2] = lo;
+                }
+                bound[(runs + 1) / 2] = n;
+                run_tasks(t, ntasks);
+                struct datum **s = src;
+                src = dst;
+                dst = s;
+        }
+        if (src != v) memcpy(v, src, n * sizeof *v);
+}
@@ -26,7 +26,7 @@
 /*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
 /*    POSSIBILITY OF SUCH DAMAGE. */
 
-#include <gc.h>
+#include "alloc.h"
 #include <string.h>
 #include "error.h"
 #include "strvec.h"
@@ -40,8 +40,7 @@ struct str_vec {
 // returns an empty string vector
 struct str_vec *str_vec_new(void)
 {
-        struct str_vec *rv = GC_malloc(sizeof *rv);
-        if (rv == NULL) enomem();
+        struct str_vec *rv = alloc_object_of(ALLOC_TERM, sizeof *rv);
         rv->n = 0;
         rv->maxn = 0;
         rv->vec = NULL;
@@ -55,8 +54,7 @@ void str_vec_append(struct str_vec *v, const char *str)
         if (v->n >= v->maxn) {
                 // double the capacity of the vector (starting with 2)
                 v->maxn = v->maxn > 0 ? 2*v->maxn : 2;
-                v->vec = GC_realloc(v->vec, v->maxn * sizeof *v->vec);
-                if (v->vec == NULL) enomem();
+                v->vec = alloc_realloc(v->vec, v->maxn * sizeof *v->vec);
         }
         v->vec[v->n++] = str;
 }
@@ -67,14 +65,13 @@ size_t str_vec_len(struct str_vec *v)
         return v->n;
 }
 
-// returns a GC_malloc'd array corresponding to the string vector
+// returns a freshly allocated array corresponding to the string vector
 const char **str_vec_to_array(struct str_vec *v)
 {
         // We try to make a copy so that we do not have to keep around
         // (in the worst case) nearly double the needed memory
         // (usually v will be garbage after this function)
-        const char **rv = GC_malloc(v->n * sizeof *rv);
-        if (rv == NULL) return v->vec;
+        const char **rv = alloc_object_of(ALLOC_TERM, v->n * sizeof *rv);
         memcpy(rv, v->vec, v->n * sizeof *rv);
         return rv;
 }
@@ -41,7 +41,7 @@ void str_vec_append(struct str_vec *, const char *str);
 // returns the number of strings in the string vector
 size_t str_vec_len(struct str_vec *);
 
-// returns a GC_malloc'd array corresponding to the string vector
+// returns a freshly allocated array corresponding to the string vector
 // NOTE: modifying the array may or may not modify the string vector
 const char **str_vec_to_array(struct str_vec *);
 
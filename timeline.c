@@ -0,0 +1,219 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "alloc.h"
+#include "primops.h"
+#include "timeline.h"
+
+struct event {
+        uint64_t start, dur;    // in nanoseconds since timeline_start
+        // the name of a closure or collection, or NULL for a primitive,
+        // whose name is looked up only when the file is written
+        const char *name;
+        prim_fun prim;
+};
+
+#define NOT_SAMPLED UINT64_MAX
+
+struct call {
+        struct datum *fun;
+        uint64_t start;         // NOT_SAMPLED if the call is not timed
+};
+
+_Bool timeline_on = 0;
+
+// whether calls are recorded, and not only tracked
+static _Bool recording = 0;
+static const char *path;
+static unsigned long sample, sample_count;
+static uint64_t min_ns;
+static struct timespec epoch;
+
+static struct event *ring;
+static size_t ring_next = 0;
+static uint64_t recorded = 0;
+
+// the calls in progress, kept where the collector sees the functions
+static struct call *calls = NULL;
+static size_t depth = 0, calls_max = 0;
+
+static uint64_t gc_start;
+static const char gc_name[] = "GC";
+
+static uint64_t now(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)(ts.tv_sec - epoch.tv_sec) * 1000000000u
+                + (uint64_t)ts.tv_nsec - (uint64_t)epoch.tv_nsec;
+}
+
+static void record(uint64_t start, uint64_t end, const char *name,
+                   prim_fun prim)
+{
+        struct event *e = &ring[ring_next];
+        e->start = start;
+        e->dur = end - start;
+        e->name = name;
+        e->prim = prim;
+        ring_next = (ring_next + 1) % TIMELINE_EVENTS;
+        recorded++;
+}
+
+void timeline_enter(struct datum *fun)
+{
+        if (depth == calls_max) {
+                calls_max = 2 * calls_max + 64;
+                calls = alloc_realloc(calls, calls_max * sizeof *calls);
+        }
+        calls[depth].fun = fun;
+        calls[depth].start = NOT_SAMPLED;
+        if (recording && ++sample_count >= sample) {
+                sample_count = 0;
+                calls[depth].start = now();
+        }
+        depth++;
+}
+
+void timeline_exit(void)
+{
+        struct call *c = &calls[--depth];
+        if (c->start != NOT_SAMPLED) {
+                uint64_t end = now();
+                if (end - c->start >= min_ns) {
+                        if (get_type(c->fun) == T_PRIMITIVE) {
+                                record(c->start, end, NULL,
+                                       get_primitive_fun(c->fun));
+                        } else {
+                                const char *name = get_closure_name(c->fun);
+                                record(c->start, end,
+                                       name != NULL ? name : "LAMBDA", NULL);
+                        }
+                }
+        }
+        c->fun = NULL;
+}
+
+struct datum *timeline_current(void)
+{
+        return depth > 0 ? calls[depth - 1].fun : NULL;
+}
+
+size_t timeline_depth(void)
+{
+        return depth;
+}
+
+void timeline_unwind(size_t d)
+{
+        while (depth > d) timeline_exit();
+}
+
+static void collection(_Bool start)
+{
+        if (start) {
+                gc_start = now();
+        } else {
+                record(gc_start, now(), gc_name, NULL);
+        }
+}
+
+static void write_string(FILE *fp, const char *s)
+{
+        putc('"', fp);
+        for (; *s != '\0'; s++) {
+                unsigned char c = (unsigned char)*s;
+                if (c == '"' || c == '\\') {
+                        fprintf(fp, "\\%c", c);
+                } else if (c < 0x20) {
+                        fprintf(fp, "\\u%04x", c);
+                } else {
+                        putc(c, fp);
+                }
+        }
+        putc('"', fp);
+}
+
+static void write_timeline(void)
+{
+        // calls still in progress (at an uncaught error) end now
+        timeline_unwind(0);
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL) {
+                perror(path);
+                return;
+        }
+        fputs("{\"traceEvents\":[\n", fp);
+        size_t n = recorded < TIMELINE_EVENTS ? recorded : TIMELINE_EVENTS;
+        size_t first = recorded < TIMELINE_EVENTS ? 0 : ring_next;
+        for (size_t i = 0; i < n; i++) {
+                struct event *e = &ring[(first + i) % TIMELINE_EVENTS];
+                const char *name = e->name;
+                if (name == NULL) name = get_primop_name(e->prim);
+                if (name == NULL) name = "#<primitive>";
+                fputs("{\"name\":", fp);
+                write_string(fp, name);
+                fprintf(fp, ",\"cat\":\"%s\",\"ph\":\"X\","
+                        "\"ts\":%" PRIu64 ".%03u,\"dur\":%" PRIu64 ".%03u,"
+                        "\"pid\":1,\"tid\":1}%s\n",
+                        e->name == gc_name ? "gc" : "call",
+                        e->start / 1000, (unsigned)(e->start % 1000),
+                        e->dur / 1000, (unsigned)(e->dur % 1000),
+                        i + 1 < n ? "," : "");
+        }
+        fprintf(fp, "],\n\"displayTimeUnit\":\"ns\",\n"
+                "\"otherData\":{\"dropped\":\"%" PRIu64 "\"}}\n",
+                recorded - n);
+        if (fclose(fp) != 0) perror(path);
+}
+
+void timeline_start(const char *p, unsigned long s, unsigned long min_us)
+{
+        path = p;
+        sample = s > 0 ? s : 1;
+        sample_count = sample - 1;
+        min_ns = (uint64_t)min_us * 1000;
+        ring = alloc_object(TIMELINE_EVENTS * sizeof *ring);
+        clock_gettime(CLOCK_MONOTONIC, &epoch);
+        alloc_on_collection(collection);
+        atexit(write_timeline);
+        recording = 1;
+        timeline_on = 1;
+}
+
+void timeline_track(void)
+{
+        timeline_on = 1;
+}
@@ -0,0 +1,80 @@
+/* simple-lisp - A simple demonstration interpreter for a tiny Lisp-like language */
+/* Copyright © 2017 Antti-Juhani Kaijanaho */
+
+/*     Redistribution and use in source and binary forms, with or without */
+/*     modification, are permitted provided that the following conditions */
+/*     are met: */
+ 
+/*      * Redistributions of source code must retain the above copyright */
+/*        notice, this list of conditions and the following disclaimer. */
+ 
+/*      * Redistributions in binary form must reproduce the above */
+/*        copyright notice, this list of conditions and the following */
+/*        disclaimer in the documentation and/or other materials provided */
+/*        with the distribution. */
+ 
+/*    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS */
+/*    "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT */
+/*    LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS */
+/*    FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE */
+/*    COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, */
+/*    INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, */
+/*    BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; */
+/*    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER */
+/*    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT */
+/*    LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN */
+/*    ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE */
+/*    POSSIBILITY OF SUCH DAMAGE. */
+
+
+#ifndef GUARD_TIMELINE_H
+#define GUARD_TIMELINE_H
+
+#include <stddef.h>
+#include "data.h"
+
+/* A timeline of the calls the program makes, written at exit in the
+   Chrome trace-event format (to be viewed in chrome://tracing or
+   Perfetto).  Every application of a closure or a primitive, by
+   either engine, becomes a complete ("X") event named after the
+   DEFINE or LABEL that bound the closure, or after the primitive;
+   garbage collections become events named GC.  A tail call in the
+   tree engine ends the event of its caller.  Calls that the compiled
+   engine inlines or runs on unboxed numbers (see compile.h) are part
+   of the event of their caller.
+
+   To bound the overhead and the size of the file, only one call in
+   sample is timed, calls that take less than min_us microseconds are
+   left out, and only the last TIMELINE_EVENTS events are kept, in a
+   ring buffer.
+ */
+
+#define TIMELINE_EVENTS 65536
+
+// set by timeline_start or timeline_track; the functions below may
+// only be called then
+extern _Bool timeline_on;
+
+/* Starts recording, to be written to the file at path at exit. */
+void timeline_start(const char *path, unsigned long sample,
+                    unsigned long min_us);
+
+/* Starts keeping track of the calls in progress, for
+   timeline_current, without recording them. */
+void timeline_track(void);
+
+/* Marks the start of a call of fun, and the end of the innermost call
+   in progress. */
+void timeline_enter(struct datum *fun);
+void timeline_exit(void);
+
+/* Returns the function of the innermost call in progress, or NULL if
+   there is none. */
+struct datum *timeline_current(void);
+
+/* Returns the number of calls in progress.  Ends the calls beyond the
+   first depth ones, which an error has unwound. */
+size_t timeline_depth(void);
+void timeline_unwind(size_t depth);
+
+#endif /* GUARD_TIMELINE_H */